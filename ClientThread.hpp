@@ -0,0 +1,174 @@
+#pragma once
+
+/*
+ * ClientThread moves a Client's socket work (and message decoding) off the
+ *  game thread.
+ *
+ * With threaded == true, a network thread polls the Client, calls the decoder
+ *  whenever data arrives, and hands the decoded events to the game thread
+ *  through a lock-free single-producer/single-consumer queue. Data the game
+ *  writes to 'outgoing' travels the other way (through another queue) when the
+ *  game calls poll(). The Client must not be touched directly while the thread
+ *  is running.
+ *
+ * With threaded == false there is no thread: poll() polls the Client inline
+ *  (like calling client.poll(..., 0.0)), so game code looks the same either way.
+ *
+ * Errors (exceptions thrown by the decoder, or the connection closing) are
+ *  rethrown from poll() on the game thread.
+ *
+ * For example:
+
+ClientThread< MyEvent > network(client, true, [](RingBuffer &buffer, std::function< void(MyEvent &&) > const &emit){
+	//pop complete messages from buffer, calling emit() with each one's event
+});
+//every frame:
+MessageWriter message(network.outgoing, 'x', 0);
+network.poll(); //send 'outgoing' (and, if not threaded, receive)
+MyEvent event;
+while (network.try_pop(&event)) {
+	//...
+}
+
+ */
+
+#include "Connection.hpp"
+#include "SPSCQueue.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <exception>
+#include <stdexcept>
+
+template< typename Event >
+struct ClientThread {
+	//Decoder is called (on the network thread, if threaded) with the connection's recv_buffer whenever
+	// data arrives; it should pop every complete message from the buffer, calling 'emit' with the
+	// resulting events, and throw if the data is garbage:
+	typedef std::function< void(RingBuffer &buffer, std::function< void(Event &&) > const &emit) > Decoder;
+
+	ClientThread(Client &client, bool threaded, Decoder const &decoder);
+	~ClientThread(); //stops the network thread
+	ClientThread(ClientThread const &) = delete;
+
+	//(game thread) data to send; write to it, then call poll():
+	RingBuffer outgoing;
+
+	//(game thread) hand off 'outgoing', and (if not threaded) send and receive data:
+	// throws if the network thread has hit an error or the connection has closed
+	void poll();
+
+	//(game thread) move the next decoded event into '*event'; returns false if there isn't one:
+	bool try_pop(Event *event) {
+		if (!threaded) {
+			if (inline_events.empty()) return false;
+			*event = std::move(inline_events.front());
+			inline_events.pop_front();
+			return true;
+		}
+		return events.try_pop(event);
+	}
+
+	//internals:
+	Client &client;
+	Decoder decoder;
+	bool threaded;
+
+	SPSCQueue< Event > events; //network -> game thread
+	SPSCQueue< std::vector< char > > sends; //game -> network thread
+	std::deque< Event > inline_events; //(not threaded) events decoded by poll()
+
+	std::thread thread;
+	std::atomic< bool > stop{false};
+	std::atomic< bool > failed{false};
+	std::exception_ptr failure; //(written by the network thread before 'failed' is set)
+
+	//queue capacities; a full queue makes the producer wait:
+	static constexpr size_t EventCapacity = 1024;
+	static constexpr size_t SendCapacity = 256;
+	//network thread re-checks for data to send at least this often (seconds):
+	static constexpr double ThreadPollTimeout = 0.001;
+
+	//poll the client, decoding received data into 'emit':
+	void poll_client(std::function< void(Event &&) > const &emit, double timeout);
+};
+
+//------------------------------------
+
+template< typename Event >
+ClientThread< Event >::ClientThread(Client &client_, bool threaded_, Decoder const &decoder_)
+	: client(client_), decoder(decoder_), threaded(threaded_), events(EventCapacity), sends(SendCapacity) {
+	if (!threaded) return;
+
+	thread = std::thread([this](){
+		auto emit = [this](Event &&event) {
+			while (!events.try_push(std::move(event))) {
+				if (stop.load(std::memory_order_relaxed)) return;
+				std::this_thread::yield();
+			}
+		};
+		std::vector< char > data;
+		try {
+			while (!stop.load(std::memory_order_relaxed)) {
+				while (sends.try_pop(&data)) {
+					client.connection.send_raw(data.data(), data.size());
+				}
+				poll_client(emit, ThreadPollTimeout);
+			}
+		} catch (...) {
+			failure = std::current_exception();
+			failed.store(true, std::memory_order_release);
+		}
+	});
+}
+
+template< typename Event >
+ClientThread< Event >::~ClientThread() {
+	stop = true;
+	if (thread.joinable()) thread.join();
+}
+
+template< typename Event >
+void ClientThread< Event >::poll_client(std::function< void(Event &&) > const &emit, double timeout) {
+	client.poll([&](Connection *c, Connection::Event event){
+		if (event == Connection::OnClose) {
+			throw std::runtime_error("Lost connection to server!");
+		} else if (event == Connection::OnRecv) {
+			decoder(c->recv_buffer, emit);
+		}
+	}, timeout);
+}
+
+template< typename Event >
+void ClientThread< Event >::poll() {
+	if (!threaded) {
+		if (!outgoing.empty()) {
+			RingBuffer::Span spans[2];
+			uint32_t count = outgoing.read_spans(spans);
+			for (uint32_t i = 0; i < count; ++i) {
+				client.connection.send_raw(spans[i].data, spans[i].size);
+			}
+			outgoing.clear();
+		}
+		poll_client([this](Event &&event){
+			inline_events.emplace_back(std::move(event));
+		}, 0.0);
+		return;
+	}
+
+	if (failed.load(std::memory_order_acquire)) {
+		std::rethrow_exception(failure);
+	}
+	if (!outgoing.empty()) {
+		std::vector< char > data(outgoing.size());
+		outgoing.peek(0, data.data(), data.size());
+		outgoing.clear();
+		while (!sends.try_push(std::move(data))) {
+			if (failed.load(std::memory_order_acquire)) std::rethrow_exception(failure);
+			std::this_thread::yield();
+		}
+	}
+}
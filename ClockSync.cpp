@@ -0,0 +1,54 @@
+#include "ClockSync.hpp"
+
+#include <algorithm>
+
+void RoundTrips::add(uint64_t rtt_ns) {
+	double sample = double(rtt_ns) * 1e-9;
+	rtt_us.add(rtt_ns / 1000);
+	if (last_ns == 0) {
+		rtt = sample;
+	} else {
+		uint64_t difference = (rtt_ns > last_ns ? rtt_ns - last_ns : last_ns - rtt_ns);
+		jitter_us.add(difference / 1000);
+		jitter += (double(difference) * 1e-9 - jitter) / 16.0;
+		rtt += (sample - rtt) / 8.0;
+	}
+	last_ns = std::max< uint64_t >(rtt_ns, 1); //(0 means "none yet")
+}
+
+bool ClockSync::ping(uint64_t now, Ping *ping) {
+	if (now < next_ping) return false;
+	double interval = (pings < QuickPings ? PingInterval / QuickPings : PingInterval);
+	next_ping = now + uint64_t(interval * 1e9);
+	pings += 1;
+
+	ping->sent = now;
+	ping->echo = echo;
+	ping->held = (echo ? now - echo_arrived : 0);
+	return true;
+}
+
+bool ClockSync::pong(uint64_t ping_sent, uint64_t ping_received, uint64_t pong_sent, uint64_t now) {
+	if (ping_sent == 0 || ping_sent > now || pong_sent < ping_received) return false;
+	uint64_t total = now - ping_sent;
+	uint64_t held = pong_sent - ping_received; //(time spent on the server)
+	if (held > total) return false;
+	uint64_t rtt = total - held;
+
+	//((t1 - t0) + (t2 - t3)) / 2, without overflowing:
+	int64_t offset = int64_t(ping_received - ping_sent) / 2 + int64_t(pong_sent - now) / 2;
+
+	round_trips.add(rtt);
+	samples[next_sample] = Sample{rtt, offset};
+	next_sample = (next_sample + 1) % FilterSize;
+	filled = std::min(filled + 1, FilterSize);
+	Sample const *best = &samples[0];
+	for (uint32_t i = 1; i < filled; ++i) {
+		if (samples[i].rtt_ns < best->rtt_ns) best = &samples[i];
+	}
+	offset_ns = best->offset_ns;
+
+	echo = pong_sent;
+	echo_arrived = now;
+	return true;
+}
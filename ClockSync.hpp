@@ -0,0 +1,106 @@
+#pragma once
+
+/*
+ * ClockSync measures latency to the server, and how the server's clock
+ *  relates to the client's, with ping ('q') and pong ('o') messages (see
+ *  Protocol.hpp), NTP-style:
+ *   the client stamps each ping with its clock when sending it (t0);
+ *   the server notes when the ping arrived (t1) and when it sent the pong (t2);
+ *   the client notes when the pong arrived (t3). Then:
+ *   round trip = (t3 - t0) - (t2 - t1)
+ *   offset (server clock - client clock) = ((t1 - t0) + (t2 - t3)) / 2
+ *  The offset is exact when both legs of the trip took as long; queueing
+ *  makes them lopsided (and the round trip longer), so the offset used is
+ *  the one from the fastest of the last FilterSize round trips (as in
+ *  NTP's clock filter).
+ *
+ * Each ping also echoes the newest pong's t2 and how long the client held
+ *  on to it, so the server can measure the round trip on its own clock
+ *  (now - t2 - held) without trusting the client's.
+ *
+ * All times are monotonic clocks in nanoseconds (see monotonic_ns()), so
+ *  neither side's wall clock matters.
+ *
+ * RoundTrips keeps the running statistics of one connection's round trips:
+ *  smoothed values (for game code -- e.g., interpolation delay or lag
+ *  compensation) and histograms (for metrics).
+ *
+ * For example:
+
+//client:
+ClockSync clock_sync;
+ClockSync::Ping ping;
+if (clock_sync.ping(monotonic_ns(), &ping)) {
+	//...send ping.sent, ping.echo, ping.held in a 'q' message
+}
+//...on an 'o' message:
+clock_sync.pong(ping_sent, ping_received, pong_sent, monotonic_ns());
+uint64_t server_now = clock_sync.server_time(monotonic_ns());
+double rtt = clock_sync.round_trips.rtt;
+
+//server, on a 'q' message:
+if (ping.echo) round_trips.add(monotonic_ns() - ping.echo - ping.held);
+
+ */
+
+#include "Histogram.hpp"
+
+#include <chrono>
+#include <cstdint>
+
+//steady_clock time (now, by default) in nanoseconds:
+inline uint64_t monotonic_ns(std::chrono::steady_clock::time_point when = std::chrono::steady_clock::now()) {
+	return uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(when.time_since_epoch()).count());
+}
+
+struct RoundTrips {
+	//record a round trip:
+	void add(uint64_t rtt_ns);
+
+	uint64_t count() const { return rtt_us.count; }
+
+	double rtt = 0.0; //seconds, smoothed (each round trip counts 1/8, as for TCP's SRTT)
+	double jitter = 0.0; //seconds, smoothed difference between consecutive round trips (each counts 1/16, as for RTP's jitter)
+	Histogram rtt_us;
+	Histogram jitter_us; //difference between consecutive round trips
+
+	//internals:
+	uint64_t last_ns = 0; //newest round trip (0 => none yet)
+};
+
+struct ClockSync {
+	static constexpr double PingInterval = 1.0; //seconds between pings
+	static constexpr uint32_t QuickPings = 4; //the first few go out PingInterval / QuickPings apart, to sync sooner
+	static constexpr uint32_t FilterSize = 8; //round trips the offset is picked from
+
+	//what goes in a 'q' message:
+	struct Ping {
+		uint64_t sent = 0; //t0
+		uint64_t echo = 0; //t2 of the newest pong (0 => none yet)
+		uint64_t held = 0; //nanoseconds between that pong arriving and this ping being sent
+	};
+	//if a ping is due at 'now', fill in '*ping' and return true:
+	bool ping(uint64_t now, Ping *ping);
+
+	//got a pong at 'now' (returns false -- and ignores it -- if its times are inconsistent):
+	bool pong(uint64_t ping_sent, uint64_t ping_received, uint64_t pong_sent, uint64_t now);
+
+	bool synced() const { return filled != 0; }
+	int64_t offset_ns = 0; //server clock - client clock (0 until synced)
+	uint64_t server_time(uint64_t client_time) const { return client_time + uint64_t(offset_ns); }
+
+	RoundTrips round_trips;
+
+	//internals:
+	struct Sample {
+		uint64_t rtt_ns;
+		int64_t offset_ns;
+	};
+	Sample samples[FilterSize]; //(ring of the newest 'filled')
+	uint32_t filled = 0;
+	uint32_t next_sample = 0;
+	uint32_t pings = 0; //sent so far
+	uint64_t next_ping = 0; //(0 => right away)
+	uint64_t echo = 0; //t2 of the newest pong
+	uint64_t echo_arrived = 0; //when it arrived
+};
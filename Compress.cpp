@@ -0,0 +1,159 @@
+#include "Compress.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+	constexpr size_t MinMatch = 4; //shortest match
+	constexpr size_t LastLiterals = 5; //the block always ends with at least this many literals
+	constexpr size_t MatchStartLimit = 12; //matches start at least this far from the end
+	constexpr size_t MaxOffset = 65535;
+	constexpr uint32_t MaxHashBits = 12;
+	constexpr uint32_t MinHashBits = 8;
+
+	uint32_t read32(char const *at) {
+		uint32_t value;
+		std::memcpy(&value, at, sizeof(value));
+		return value;
+	}
+	uint32_t hash(uint32_t value, uint32_t bits) {
+		return (value * 2654435761u) >> (32 - bits);
+	}
+
+	//write the extra bytes of a token's length field (for lengths of 15 or more):
+	bool write_length(size_t length, char *&out, char *end) {
+		length -= 15;
+		while (length >= 255) {
+			if (out == end) return false;
+			*out++ = char(255);
+			length -= 255;
+		}
+		if (out == end) return false;
+		*out++ = char(length);
+		return true;
+	}
+
+	//write a sequence (literals, then a match unless 'last'):
+	bool write_sequence(char const *literals, size_t literal_count, bool last, size_t offset, size_t match_length, char *&out, char *end) {
+		if (out == end) return false;
+		char *token = out++;
+		uint8_t bits = uint8_t(std::min< size_t >(literal_count, 15) << 4);
+		if (literal_count >= 15 && !write_length(literal_count, out, end)) return false;
+		if (size_t(end - out) < literal_count) return false;
+		if (literal_count) std::memcpy(out, literals, literal_count);
+		out += literal_count;
+		if (!last) {
+			if (end - out < 2) return false;
+			*out++ = char(offset & 0xff);
+			*out++ = char(offset >> 8);
+			size_t length = match_length - MinMatch;
+			bits |= uint8_t(std::min< size_t >(length, 15));
+			if (length >= 15 && !write_length(length, out, end)) return false;
+		}
+		*token = char(bits);
+		return true;
+	}
+
+	//read the extra bytes of a token's length field (adding them to '*length'):
+	bool read_length(uint8_t const *&in, uint8_t const *end, size_t *length) {
+		while (true) {
+			if (in == end) return false;
+			uint8_t byte = *in++;
+			*length += byte;
+			if (*length > (size_t(1) << 31)) return false; //(nonsense; avoid overflow)
+			if (byte != 255) return true;
+		}
+	}
+}
+
+size_t compress_block(char const *src, size_t size, char *dst, size_t capacity) {
+	char *out = dst;
+	char *out_end = dst + capacity;
+	char const *end = src + size;
+	char const *anchor = src; //start of literals not yet written
+
+	if (size > MatchStartLimit) {
+		//most recent position (offset from src) with each hash:
+		// (small inputs use a smaller table, since clearing the whole thing would cost more than compressing)
+		uint32_t bits = MinHashBits;
+		while (bits < MaxHashBits && (size_t(1) << bits) < size) ++bits;
+		uint32_t table[1 << MaxHashBits];
+		std::fill(table, table + (1 << bits), 0);
+
+		char const *match_start_limit = end - MatchStartLimit;
+		char const *match_end_limit = end - LastLiterals;
+
+		char const *at = src + 1;
+		while (at <= match_start_limit) {
+			uint32_t h = hash(read32(at), bits);
+			char const *candidate = src + table[h];
+			table[h] = uint32_t(at - src);
+			if (candidate >= at || size_t(at - candidate) > MaxOffset || read32(candidate) != read32(at)) {
+				//no match; step faster the longer it's been since the last one (so incompressible data is cheap):
+				at += 1 + ((at - anchor) >> 6);
+				continue;
+			}
+			//extend the match backward (over pending literals) and forward:
+			while (at > anchor && candidate > src && at[-1] == candidate[-1]) {
+				--at;
+				--candidate;
+			}
+			char const *match_end = at + MinMatch;
+			char const *from = candidate + MinMatch;
+			while (match_end < match_end_limit && *match_end == *from) {
+				++match_end;
+				++from;
+			}
+			if (!write_sequence(anchor, size_t(at - anchor), false, size_t(at - candidate), size_t(match_end - at), out, out_end)) return 0;
+			anchor = at = match_end;
+			//(remember a position near the end of the match, since the data there is likely to repeat)
+			if (at <= match_start_limit) {
+				table[hash(read32(at - 2), bits)] = uint32_t(at - 2 - src);
+			}
+		}
+	}
+
+	if (!write_sequence(anchor, size_t(end - anchor), true, 0, 0, out, out_end)) return 0;
+	return size_t(out - dst);
+}
+
+bool decompress_block(char const *src_, size_t size, char *dst, size_t dst_size) {
+	uint8_t const *in = reinterpret_cast< uint8_t const * >(src_);
+	uint8_t const *in_end = in + size;
+	char *out = dst;
+	char *out_end = dst + dst_size;
+
+	while (true) {
+		if (in == in_end) return false;
+		uint8_t token = *in++;
+
+		size_t literal_count = token >> 4;
+		if (literal_count == 15 && !read_length(in, in_end, &literal_count)) return false;
+		if (size_t(in_end - in) < literal_count || size_t(out_end - out) < literal_count) return false;
+		if (literal_count) std::memcpy(out, in, literal_count);
+		in += literal_count;
+		out += literal_count;
+
+		if (in == in_end) return out == out_end; //(last sequence has no match)
+
+		if (in_end - in < 2) return false;
+		size_t offset = size_t(in[0]) | (size_t(in[1]) << 8);
+		in += 2;
+		if (offset == 0 || offset > size_t(out - dst)) return false;
+
+		size_t match_length = token & 0xf;
+		if (match_length == 15 && !read_length(in, in_end, &match_length)) return false;
+		match_length += MinMatch;
+		if (size_t(out_end - out) < match_length) return false;
+
+		char const *from = out - offset;
+		if (offset >= match_length) {
+			std::memcpy(out, from, match_length);
+		} else {
+			//(overlapping match -- repeats the last 'offset' bytes -- so copy byte-by-byte)
+			for (size_t i = 0; i < match_length; ++i) out[i] = from[i];
+		}
+		out += match_length;
+	}
+}
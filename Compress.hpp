@@ -0,0 +1,41 @@
+#pragma once
+
+/*
+ * A small, fast block compressor in the LZ4 block format (greedy matching
+ *  with a hash table of up to 4096 entries; no entropy coding), for compressing
+ *  messages on the fly without a measurable CPU cost.
+ *
+ * The format is LZ4's: a series of sequences, each
+ *  [token] - 1 byte: literal count (high 4 bits), match length - 4 (low 4 bits)
+ *            (a 15 in either is followed by more bytes: add each, until one isn't 255)
+ *  [literals] - literal count bytes
+ *  [offset] - uint16_t (little-endian), distance back to the match (not in the last sequence)
+ * ending with a sequence that is literals only.
+ *
+ * The block doesn't store its decompressed size; the caller sends that
+ *  separately (see compressed messages in Message.hpp).
+ *
+ * For example:
+
+std::vector< char > packed(compress_bound(size));
+packed.resize(compress_block(data, size, packed.data(), packed.size()));
+//...
+std::vector< char > unpacked(size);
+if (!decompress_block(packed.data(), packed.size(), unpacked.data(), unpacked.size())) throw ...
+
+ */
+
+#include <cstddef>
+
+//largest compressed size of 'size' bytes:
+inline size_t compress_bound(size_t size) {
+	return size + size / 255 + 16;
+}
+
+//compress 'size' bytes from 'src' into 'dst'; returns compressed size (0 if it won't fit in 'capacity'):
+// (capacity >= compress_bound(size) always fits)
+size_t compress_block(char const *src, size_t size, char *dst, size_t capacity);
+
+//decompress 'size' bytes from 'src' into exactly 'dst_size' bytes at 'dst':
+// returns false (leaving 'dst' partly written) if 'src' is garbage or doesn't decompress to exactly 'dst_size' bytes
+bool decompress_block(char const *src, size_t size, char *dst, size_t dst_size);
@@ -20,20 +20,34 @@ typedef int ssize_t;
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 #include <netinet/ip.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 #include <netdb.h>
+#include <fcntl.h>
 
 #define closesocket close
 
 #endif
 
 #include "Connection.hpp"
+#include "Log.hpp"
+
+#ifdef CONNECTION_USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+#ifdef CONNECTION_USE_IO_URING
+#include "IoUring.hpp"
+#include <poll.h>
+#endif
 
 //------------------------------------------------------
 
 #include <iostream>
+#include <chrono>
 #include <cmath>
 #include <algorithm>
 #include <cassert>
@@ -50,11 +64,371 @@ void Connection::close() {
 		::closesocket(socket);
 		socket = InvalidSocket;
 	}
+	mark_pending(); //(so poll() discards it)
+}
+
+void Connection::send_shared(SharedPayload const &payload, size_t begin, size_t end) {
+	assert(payload && begin <= end && end <= payload->size());
+	if (begin == end) return;
+	send_slices.emplace_back();
+	send_slices.back().payload = payload;
+	send_slices.back().begin = begin;
+	send_slices.back().end = end;
+	send_slices.back().after = send_buffer_sent + send_buffer.size();
+	send_slices_size += end - begin;
+	if (send_queue_size() > send_high_water) send_backed_up = true;
+	mark_pending();
+}
+
+//---------------------------------
+//Per-socket helpers used by both the select() and epoll() polling backends:
+
+//accept pending connections on listen_socket:
+// (accepts at most one connection unless 'drain' is set, in which case accepts until EAGAIN)
+static void accept_connections(
+	char const *where,
+	std::list< Connection > &connections,
+	std::function< void(Connection *, Connection::Event event) > const &on_event,
+	Socket listen_socket,
+	bool drain,
+	std::function< void(Connection *) > const &on_accept = nullptr) {
+
+	do {
+		Socket got = accept(listen_socket, NULL, NULL);
+		if (got == InvalidSocket) {
+			//oh well. (or, when draining, no more pending connections)
+			break;
+		} else {
+			#ifdef _WIN32
+			unsigned long one = 1;
+			if (0 == ioctlsocket(got, FIONBIO, &one)) {
+			#else
+			{
+			#endif
+				connections.emplace_back();
+				connections.back().socket = got;
+				LOG_INFO("[" << where << "] client connected on " << connections.back().socket << ".");
+				if (on_accept) on_accept(&connections.back());
+				if (on_event) on_event(&connections.back(), Connection::OnOpen);
+			}
+		}
+	} while (drain);
+}
+
+//read available data from c.socket directly into c.recv_buffer:
+// (stops after a short read unless 'drain' is set, in which case reads until EAGAIN -- as edge-triggered epoll requires)
+static void recv_from(
+	char const *where,
+	Connection &c,
+	std::function< void(Connection *, Connection::Event event) > const &on_event,
+	bool drain) {
+
+	const uint32_t ReadSize = 16384; //free space to make available before each read
+
+	size_t burst = 0; //bytes read this call
+	while (true) { //read until more data left to read
+		c.recv_buffer.reserve(ReadSize);
+		RingBuffer::Span spans[2];
+		uint32_t span_count = c.recv_buffer.write_spans(spans);
+		size_t space = 0;
+		for (uint32_t i = 0; i < span_count; ++i) space += spans[i].size;
+
+		#ifdef _WIN32
+		ssize_t ret = recv(c.socket, spans[0].data, int(spans[0].size), MSG_DONTWAIT);
+		space = spans[0].size;
+		#else
+		struct iovec iov[2];
+		for (uint32_t i = 0; i < span_count; ++i) {
+			iov[i].iov_base = spans[i].data;
+			iov[i].iov_len = spans[i].size;
+		}
+		struct msghdr msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.msg_iov = iov;
+		msg.msg_iovlen = span_count;
+		ssize_t ret = recvmsg(c.socket, &msg, MSG_DONTWAIT);
+		#endif
+		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			//~no problem~ but no data
+			break;
+		} else if (ret <= 0 || ret > (ssize_t)space) {
+			//~problem~ so remove connection
+			if (ret == 0) {
+				LOG_INFO("[" << where << "] port closed, disconnecting.");
+			} else if (ret < 0) {
+				LOG_WARN("[" << where << "] recv() returned error " << errno << "(" << strerror(errno) << "), disconnecting.");
+			} else {
+				LOG_WARN("[" << where << "] recv() returned strange number of bytes, disconnecting.");
+			}
+			c.close();
+			if (on_event) on_event(&c, Connection::OnClose);
+			break;
+		} else { //ret > 0
+			c.recv_buffer.commit(ret);
+			c.stats.bytes_in += size_t(ret);
+			burst += size_t(ret);
+			if (on_event) on_event(&c, Connection::OnRecv);
+			if (c.socket == InvalidSocket) break; //on_event closed the connection
+			if (!drain && ret < (ssize_t)space) break; //ran out of data before buffer: no more data left to read
+		}
+	}
+	if (burst > 0) c.stats.recv_bursts.add(burst);
+}
+
+//the front of a connection's send queue (send_buffer interleaved with send_slices), as a list of spans:
+struct SendGather {
+	static constexpr uint32_t MaxSpans = 64;
+	RingBuffer::Span spans[MaxSpans];
+	bool from_slice[MaxSpans]; //does span come from send_slices (rather than send_buffer)?
+	uint32_t span_count = 0;
+	size_t total = 0;
+};
+
+//gather c's send queue, in order, into a list of spans:
+// (each span either comes from send_buffer or is one of the first few send_slices)
+static void gather_send(Connection &c, SendGather *gather_) {
+	assert(gather_);
+	SendGather &g = *gather_;
+	g.span_count = 0;
+	g.total = 0;
+
+	RingBuffer::Span ring[2];
+	uint32_t ring_count = c.send_buffer.read_spans(ring);
+	uint32_t ring_index = 0;
+	size_t ring_offset = 0; //offset into ring[ring_index]
+	uint64_t at = c.send_buffer_sent; //stream position of the next send_buffer byte
+
+	//add send_buffer bytes up to stream position 'until':
+	auto add_ring = [&](uint64_t until) {
+		while (at < until && ring_index < ring_count && g.span_count < SendGather::MaxSpans) {
+			size_t amt = size_t(std::min< uint64_t >(until - at, ring[ring_index].size - ring_offset));
+			g.spans[g.span_count].data = ring[ring_index].data + ring_offset;
+			g.spans[g.span_count].size = amt;
+			g.from_slice[g.span_count] = false;
+			g.span_count += 1;
+			g.total += amt;
+			at += amt;
+			ring_offset += amt;
+			if (ring_offset == ring[ring_index].size) {
+				ring_index += 1;
+				ring_offset = 0;
+			}
+		}
+	};
+
+	for (auto const &slice : c.send_slices) {
+		add_ring(slice.after);
+		if (g.span_count == SendGather::MaxSpans) break;
+		g.spans[g.span_count].data = const_cast< char * >(slice.payload->data()) + slice.begin;
+		g.spans[g.span_count].size = slice.end - slice.begin;
+		g.from_slice[g.span_count] = true;
+		g.span_count += 1;
+		g.total += slice.end - slice.begin;
+		if (g.span_count == SendGather::MaxSpans) break;
+	}
+	add_ring(~uint64_t(0));
+}
+
+//act on the result of sending gathered spans ('ret' bytes sent, or -1 with 'err' set):
+static void finish_send(
+	char const *where,
+	Connection &c,
+	std::function< void(Connection *, Connection::Event event) > const &on_event,
+	SendGather const &g,
+	ssize_t ret,
+	int err) {
+
+	c.stats.send_queue_high_water = std::max(c.stats.send_queue_high_water, c.send_queue_size());
+
+	if (ret < 0 && (err == EAGAIN || err == EWOULDBLOCK)) {
+		//~no problem~, but don't keep trying
+		c.write_blocked = true;
+	} else if (ret <= 0 || ret > (ssize_t)g.total) {
+		if (ret < 0) {
+			LOG_WARN("[" << where << "] send() returned error " << err << ", disconnecting.");
+		} else { assert(ret == 0 || ret > (ssize_t)g.total);
+			LOG_WARN("[" << where << "] send() returned strange number of bytes [" << ret << " of " << g.total << "], disconnecting.");
+		}
+		c.close();
+		if (on_event) on_event(&c, Connection::OnClose);
+	} else { //ret seems reasonable
+		c.stats.bytes_out += size_t(ret);
+		//consume sent bytes, span by span:
+		size_t remain = size_t(ret);
+		for (uint32_t i = 0; i < g.span_count && remain > 0; ++i) {
+			size_t amt = std::min(remain, g.spans[i].size);
+			if (g.from_slice[i]) {
+				Connection::SharedSlice &slice = c.send_slices.front();
+				slice.begin += amt;
+				c.send_slices_size -= amt;
+				if (slice.begin == slice.end) c.send_slices.pop_front();
+			} else {
+				c.send_buffer.pop(amt);
+				c.send_buffer_sent += amt;
+			}
+			remain -= amt;
+		}
+		if (c.send_queue_size() <= c.send_low_water) c.send_backed_up = false;
+	}
+}
+
+//write as much of c's send queue (send_buffer interleaved with send_slices) to c.socket as it will take:
+static void send_to(
+	char const *where,
+	Connection &c,
+	std::function< void(Connection *, Connection::Event event) > const &on_event) {
+
+	SendGather g;
+	gather_send(c, &g);
+	assert(g.span_count > 0);
+
+	#ifdef _WIN32
+	ssize_t ret = send(c.socket, g.spans[0].data, int(g.spans[0].size), MSG_DONTWAIT);
+	#else
+	struct iovec iov[SendGather::MaxSpans];
+	for (uint32_t i = 0; i < g.span_count; ++i) {
+		iov[i].iov_base = g.spans[i].data;
+		iov[i].iov_len = g.spans[i].size;
+	}
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = g.span_count;
+	ssize_t ret = sendmsg(c.socket, &msg, MSG_DONTWAIT);
+	#endif
+	finish_send(where, c, on_event, g, ret, errno);
 }
 
 //---------------------------------
 //Polling helper used by both server and client:
-void poll_connections(
+// (each backend returns the time, in seconds, that it spent waiting for events)
+
+static double seconds_since(std::chrono::steady_clock::time_point then) {
+	return std::chrono::duration< double >(std::chrono::steady_clock::now() - then).count();
+}
+
+//count a poll() that started at 'start' and spent 'waited' seconds waiting:
+static void record_poll(PollStats &stats, std::chrono::steady_clock::time_point start, double waited) {
+	stats.polls += 1;
+	stats.busy_us.add(uint64_t(std::max(0.0, seconds_since(start) - waited) * 1e6));
+}
+
+#ifdef CONNECTION_USE_EPOLL
+
+//epoll data.ptr for a Server's wake_fd (see Server::enable_wake()):
+static char WakeMarker;
+
+//add a socket to an epoll set; 'ptr' is the connection (or nullptr for a listen socket):
+static void epoll_watch(char const *where, int epoll_fd, Socket socket, Connection *ptr) {
+	struct epoll_event evt;
+	memset(&evt, 0, sizeof(evt));
+	evt.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+	if (ptr) evt.events |= EPOLLOUT;
+	evt.data.ptr = ptr;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, socket, &evt) != 0) {
+		LOG_WARN("[" << where << "] epoll_ctl() returned error " << errno << "(" << strerror(errno) << ").");
+	}
+}
+
+//edge-triggered epoll backend:
+// - readiness is only reported for sockets that changed state, so the wait (and the
+//   recv work that follows) scales with ready sockets rather than total connections.
+// - sends only look at the pending list (connections that queued data or were closed;
+//   see Connection::mark_pending()), so they scale with busy connections, too.
+// - sockets stay registered until closed (closing a socket drops it from the epoll set).
+// - a connection is only marked write_blocked after send() returns EAGAIN, and is
+//   unblocked (and made pending again) by the next EPOLLOUT edge.
+// - closed connections are moved from the pending list to '*closed' (linked the same way),
+//   for the caller to discard.
+// - 'wake_fd' (if not -1) is an eventfd registered with WakeMarker; it just ends the wait.
+double poll_connections(
+	char const *where,
+	std::list< Connection > &connections,
+	std::function< void(Connection *, Connection::Event event) > const &on_event,
+	double timeout,
+	int epoll_fd,
+	Connection *&pending,
+	Connection **closed,
+	int wake_fd = -1,
+	Socket listen_socket = InvalidSocket) {
+
+	//don't wait if there is data that could be sent right now:
+	for (Connection const *c = pending; c; c = c->pending_next) {
+		if (c->socket != InvalidSocket && c->send_pending() && !c->write_blocked) {
+			timeout = 0.0;
+			break;
+		}
+	}
+
+	constexpr int MaxEvents = 256; //any more ready sockets stay on the ready list until the next call
+	struct epoll_event events[MaxEvents];
+	auto before_wait = std::chrono::steady_clock::now();
+	int count = epoll_wait(epoll_fd, events, MaxEvents, int(std::ceil(std::max(0.0, timeout) * 1000.0)));
+	double waited = seconds_since(before_wait);
+	if (count < 0) {
+		if (errno != EINTR) {
+			LOG_WARN("[" << where << "] epoll_wait() returned error " << errno << "(" << strerror(errno) << ").");
+		}
+		count = 0;
+	}
+
+	for (int i = 0; i < count; ++i) {
+		if (events[i].data.ptr == &WakeMarker) {
+			//woken by another thread; reset the eventfd's counter:
+			uint64_t value;
+			if (::read(wake_fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+				LOG_WARN("[" << where << "] read() from wake eventfd returned error " << errno << "(" << strerror(errno) << ").");
+			}
+			continue;
+		}
+		Connection *c = reinterpret_cast< Connection * >(events[i].data.ptr);
+		if (c == nullptr) {
+			//listen socket is readable; accept everything pending:
+			accept_connections(where, connections, on_event, listen_socket, true, [&](Connection *got){
+				got->pending_list = &pending;
+				got->position = std::prev(connections.end());
+				epoll_watch(where, epoll_fd, got->socket, got);
+			});
+			continue;
+		}
+		if (c->socket == InvalidSocket) continue; //closed earlier in this batch
+		if (events[i].events & EPOLLOUT) {
+			c->write_blocked = false;
+			if (c->send_pending()) c->mark_pending();
+		}
+		if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+			recv_from(where, *c, on_event, true);
+		}
+	}
+
+	//process responses (and closes):
+	// (handlers called from send_to() may make more connections pending; they go on a fresh list, for the next poll)
+	Connection *list = pending;
+	pending = nullptr;
+	while (list) {
+		Connection &c = *list;
+		list = c.pending_next;
+		c.is_pending = false;
+		c.pending_next = nullptr;
+		if (c.socket != InvalidSocket && c.send_pending() && !c.write_blocked) {
+			send_to(where, c, on_event);
+		}
+		if (c.socket == InvalidSocket) {
+			if (c.is_pending) continue; //(made pending again by a handler; it'll be moved next poll)
+			c.is_pending = true; //(never pending again)
+			c.pending_next = *closed;
+			*closed = &c;
+		} else if (c.send_pending() && !c.write_blocked) {
+			c.mark_pending(); //(couldn't send everything at once; try again next poll)
+		}
+	}
+
+	return waited;
+}
+
+#else //select() backend
+
+double poll_connections(
 	char const *where,
 	std::list< Connection > &connections,
 	std::function< void(Connection *, Connection::Event event) > const &on_event,
@@ -74,117 +448,372 @@ void poll_connections(
 	}
 
 	//add each connection's socket to read (and possibly write) sets:
-	for (auto c : connections) {
+	for (auto const &c : connections) {
 		if (c.socket != InvalidSocket) {
 			max = std::max(max, int(c.socket));
 			FD_SET(c.socket, &read_fds);
-			if (!c.send_buffer.empty()) {
+			if (c.send_pending()) {
 				FD_SET(c.socket, &write_fds);
 			}
 		}
 	}
 
+	double waited = 0.0;
 	{ //wait (until timeout) for sockets' data to become available:
 		struct timeval tv;
 		tv.tv_sec = std::lround(std::floor(timeout));
 		tv.tv_usec = std::lround((timeout - std::floor(timeout)) * 1e6);
 		//NOTE: on windows nfds is ignored -- https://msdn.microsoft.com/en-us/library/windows/desktop/ms740141(v=vs.85).aspx
+		auto before_wait = std::chrono::steady_clock::now();
 		int ret = select(max + 1, &read_fds, &write_fds, NULL, &tv);
+		waited = seconds_since(before_wait);
 
 		if (ret < 0) {
-			std::cerr << "[" << where << "] Select returned an error; will attempt to read/write anyway." << std::endl;
+			LOG_WARN("[" << where << "] Select returned an error; will attempt to read/write anyway.");
 		} else if (ret == 0) {
 			//nothing to read or write.
-			return;
+			return waited;
 		}
 	}
 
 	//add new connections as needed:
 	if (listen_socket != InvalidSocket && FD_ISSET(listen_socket, &read_fds)) {
-		Socket got = accept(listen_socket, NULL, NULL);
-		if (got == InvalidSocket) {
-			//oh well.
-		} else {
-			#ifdef _WIN32
-			unsigned long one = 1;
-			if (0 == ioctlsocket(got, FIONBIO, &one)) {
-			#else
-			{
-			#endif
-				connections.emplace_back();
-				connections.back().socket = got;
-				std::cerr << "[" << where << "] client connected on " << connections.back().socket << "." << std::endl; //INFO
-				if (on_event) on_event(&connections.back(), Connection::OnOpen);
-			}
-		}
+		accept_connections(where, connections, on_event, listen_socket, false);
 	}
 
-	const uint32_t BufferSize = 20000;
-	static thread_local char *buffer = new char[BufferSize];
-
 	//process requests:
 	for (auto &c : connections) {
 		//only read from valid sockets marked readable:
 		if (c.socket == InvalidSocket || !FD_ISSET(c.socket, &read_fds)) continue;
+		recv_from(where, c, on_event, false);
+	}
+
+	//process responses:
+	for (auto &c : connections) {
+		//don't bother with connections unless they are valid, have something to send, and are marked writable:
+		if (c.socket == InvalidSocket || !c.send_pending() || !FD_ISSET(c.socket, &write_fds)) continue;
+		send_to(where, c, on_event);
+	}
+
+	return waited;
+}
+
+#endif //CONNECTION_USE_EPOLL
+
+#ifdef CONNECTION_USE_IO_URING
+
+//io_uring backend:
+// - the listen socket has a multishot accept in flight, and every connection a multishot
+//   recv that picks buffers from the ring's provided buffers, so steady-state receiving
+//   needs no per-poll submissions at all.
+// - sends for every connection are gathered (as in send_to()) and submitted together, so a
+//   poll that flushes N connections makes one io_uring_enter() instead of N sendmsg() calls.
+// - all send completions are reaped before any handler runs, so the send queues
+//   (which the kernel reads from) are never modified while a send is in flight.
+// - as with epoll, only connections on the pending list are looked at: besides queuing data
+//   or closing (see Connection::mark_pending()), a connection is made pending when it is
+//   accepted, when its recv or POLLOUT poll completes, and whenever it is left with
+//   something to arm or send. Closed connections go to '*closed' once nothing is in flight.
 
-		while (true) { //read until more data left to read
-			ssize_t ret = recv(c.socket, buffer, BufferSize, MSG_DONTWAIT);
-			if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-				//~no problem~ but no data
-				break;
-			} else if (ret <= 0 || ret > (ssize_t)BufferSize) {
-				//~problem~ so remove connection
-				if (ret == 0) {
-					std::cerr << "[" << where << "] port closed, disconnecting." << std::endl;
-				} else if (ret < 0) {
-					std::cerr << "[" << where << "] recv() returned error " << errno << "(" << strerror(errno) << "), disconnecting." << std::endl;
+struct UringState {
+	UringState() : ring(256, 256, 8192) { }
+	IoUring ring;
+	bool accept_armed = false;
+
+	//per-send storage that must stay put until the send completes:
+	struct Send {
+		Connection *c = nullptr;
+		SendGather gather;
+		struct iovec iov[SendGather::MaxSpans];
+		struct msghdr msg;
+		int32_t res = 0;
+	};
+	std::vector< Send > sends;
+	std::vector< io_uring_cqe > completions; //non-send completions waiting to be handled
+	std::vector< Connection * > ready; //(scratch) open pending connections, this poll
+};
+
+//operation kind is stored in the low bits of each entry's user_data (the rest is a pointer):
+enum UringOp : uint64_t {
+	UringAccept = 1, //(pointer is null)
+	UringRecv = 2, //(pointer is the Connection)
+	UringSend = 3, //(pointer is the UringState::Send)
+	UringPollOut = 4, //(pointer is the Connection)
+	UringCancel = 5, //(pointer is null)
+	UringOpMask = 7
+};
+static_assert(alignof(Connection) >= 8 && alignof(UringState::Send) >= 8, "user_data needs three free bits");
+
+static inline uint64_t uring_data(void *ptr, UringOp op) {
+	return reinterpret_cast< uint64_t >(ptr) | op;
+}
+
+static void uring_arm_recv(UringState &state, Connection &c) {
+	io_uring_sqe *sqe = state.ring.get_sqe();
+	if (!sqe) return; //submission queue is full; try again next poll
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = c.socket;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = IoUring::BufferGroup;
+	if (c.uring_recv_multishot) sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->user_data = uring_data(&c, UringRecv);
+	c.uring_recv_armed = true;
+	c.uring_ops += 1;
+}
+
+static void uring_cancel(UringState &state, uint64_t user_data) {
+	io_uring_sqe *sqe = state.ring.get_sqe();
+	if (!sqe) return;
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = user_data;
+	sqe->user_data = uring_data(nullptr, UringCancel);
+}
+
+//submit whatever operations a connection is missing -- or, once it is closed, cancel the ones in flight:
+static void uring_arm(UringState &state, Connection &c) {
+	if (c.socket == InvalidSocket) {
+		//closed connections have their in-flight operations cancelled (so they can be discarded):
+		if (c.uring_ops > 0 && !c.uring_cancel_sent) {
+			if (c.uring_recv_armed) uring_cancel(state, uring_data(&c, UringRecv));
+			if (c.uring_pollout_armed) uring_cancel(state, uring_data(&c, UringPollOut));
+			c.uring_cancel_sent = true;
+		}
+		return;
+	}
+	if (!c.uring_recv_armed) uring_arm_recv(state, c);
+	if (c.write_blocked && !c.uring_pollout_armed) {
+		io_uring_sqe *sqe = state.ring.get_sqe();
+		if (sqe) {
+			sqe->opcode = IORING_OP_POLL_ADD;
+			sqe->fd = c.socket;
+			sqe->poll32_events = POLLOUT;
+			sqe->user_data = uring_data(&c, UringPollOut);
+			c.uring_pollout_armed = true;
+			c.uring_ops += 1;
+		}
+	}
+}
+
+//does an open connection still need poll() to arm something or send?
+static bool uring_needs_poll(Connection const &c) {
+	return !c.uring_recv_armed || (c.write_blocked && !c.uring_pollout_armed) || (c.send_pending() && !c.write_blocked);
+}
+
+//submit sends for the (open) connections in 'ready' that have something to send, and wait for them all to complete:
+static void uring_send_all(
+	char const *where,
+	UringState &state,
+	std::vector< Connection * > const &ready,
+	std::function< void(Connection *, Connection::Event event) > const &on_event) {
+
+	state.sends.clear();
+	state.sends.reserve(ready.size()); //(no reallocation once sends are in flight)
+	for (Connection *ready_c : ready) {
+		Connection &c = *ready_c;
+		if (c.socket == InvalidSocket || !c.send_pending() || c.write_blocked) continue;
+		io_uring_sqe *sqe = state.ring.get_sqe();
+		if (!sqe) break; //submission queue is full; rest go next poll
+
+		state.sends.emplace_back();
+		UringState::Send &send = state.sends.back();
+		send.c = &c;
+		gather_send(c, &send.gather);
+		for (uint32_t i = 0; i < send.gather.span_count; ++i) {
+			send.iov[i].iov_base = send.gather.spans[i].data;
+			send.iov[i].iov_len = send.gather.spans[i].size;
+		}
+		memset(&send.msg, 0, sizeof(send.msg));
+		send.msg.msg_iov = send.iov;
+		send.msg.msg_iovlen = send.gather.span_count;
+
+		//NOTE: each connection's queue goes in a single (gathering) sendmsg rather than a chain of
+		// linked sends, since a short send in the middle of a chain would leave a gap in the stream.
+		sqe->opcode = IORING_OP_SENDMSG;
+		sqe->fd = c.socket;
+		sqe->addr = reinterpret_cast< uint64_t >(&send.msg);
+		sqe->len = 1;
+		sqe->msg_flags = MSG_DONTWAIT; //complete with -EAGAIN rather than waiting for space
+		sqe->user_data = uring_data(&send, UringSend);
+	}
+	if (state.sends.empty()) return;
+
+	//wait for every send to complete (setting aside other completions for later):
+	size_t outstanding = state.sends.size();
+	while (outstanding > 0) {
+		if (!state.ring.submit_and_wait(1)) {
+			LOG_WARN("[" << where << "] io_uring_enter() returned error " << errno << "(" << strerror(errno) << ").");
+		}
+		io_uring_cqe cqe;
+		while (state.ring.pop_cqe(&cqe)) {
+			if ((cqe.user_data & UringOpMask) == UringSend) {
+				reinterpret_cast< UringState::Send * >(cqe.user_data & ~uint64_t(UringOpMask))->res = cqe.res;
+				outstanding -= 1;
+			} else {
+				state.completions.emplace_back(cqe);
+			}
+		}
+	}
+
+	//now that nothing is in flight, consume what was sent:
+	for (auto &send : state.sends) {
+		if (send.c->socket == InvalidSocket) continue;
+		if (send.res == -ECANCELED) continue;
+		finish_send(where, *send.c, on_event, send.gather, send.res < 0 ? -1 : send.res, -send.res);
+	}
+	state.sends.clear();
+}
+
+double poll_connections(
+	char const *where,
+	std::list< Connection > &connections,
+	std::function< void(Connection *, Connection::Event event) > const &on_event,
+	double timeout,
+	UringState &state,
+	Connection *&pending,
+	Connection **closed,
+	Socket listen_socket = InvalidSocket) {
+
+	//(re-)arm operations:
+	if (listen_socket != InvalidSocket && !state.accept_armed) {
+		io_uring_sqe *sqe = state.ring.get_sqe();
+		if (sqe) {
+			sqe->opcode = IORING_OP_ACCEPT;
+			sqe->fd = listen_socket;
+			sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+			sqe->user_data = uring_data(nullptr, UringAccept);
+			state.accept_armed = true;
+		}
+	}
+	bool sendable = false;
+	for (Connection *c = pending; c; c = c->pending_next) {
+		uring_arm(state, *c);
+		if (c->socket != InvalidSocket && c->send_pending() && !c->write_blocked) sendable = true;
+	}
+
+	//don't wait if there is data that could be sent right now (or completions already set aside):
+	if (sendable || !state.completions.empty()) timeout = 0.0;
+
+	//submit, and wait (until timeout) for something to happen:
+	auto before_wait = std::chrono::steady_clock::now();
+	if (!state.ring.submit_and_wait(timeout > 0.0 ? 1 : 0, timeout)) {
+		LOG_WARN("[" << where << "] io_uring_enter() returned error " << errno << "(" << strerror(errno) << ").");
+	}
+	double waited = seconds_since(before_wait);
+	{
+		io_uring_cqe cqe;
+		while (state.ring.pop_cqe(&cqe)) {
+			state.completions.emplace_back(cqe);
+		}
+	}
+
+	//handle completions:
+	// (handlers may accept more connections, so iterate a local copy)
+	std::vector< io_uring_cqe > completions;
+	completions.swap(state.completions);
+	for (io_uring_cqe const &cqe : completions) {
+		UringOp op = UringOp(cqe.user_data & UringOpMask);
+		bool more = (cqe.flags & IORING_CQE_F_MORE);
+		if (op == UringAccept) {
+			if (!more) state.accept_armed = false;
+			if (cqe.res < 0) {
+				LOG_WARN("[" << where << "] accept() returned error " << -cqe.res << "(" << strerror(-cqe.res) << ").");
+				continue;
+			}
+			connections.emplace_back();
+			Connection &c = connections.back();
+			c.socket = cqe.res;
+			c.pending_list = &pending;
+			c.position = std::prev(connections.end());
+			c.mark_pending(); //(to arm its recv)
+			LOG_INFO("[" << where << "] client connected on " << c.socket << ".");
+			if (on_event) on_event(&c, Connection::OnOpen);
+		} else if (op == UringRecv) {
+			Connection &c = *reinterpret_cast< Connection * >(cqe.user_data & ~uint64_t(UringOpMask));
+			if (!more) {
+				c.uring_recv_armed = false;
+				c.uring_ops -= 1;
+				c.mark_pending(); //(to re-arm it, or to discard the connection)
+			}
+			if (cqe.flags & IORING_CQE_F_BUFFER) {
+				uint16_t id = uint16_t(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+				if (cqe.res > 0 && c.socket != InvalidSocket) {
+					c.recv_buffer.push(state.ring.buffer(id), size_t(cqe.res));
+					c.stats.bytes_in += size_t(cqe.res);
+					c.stats.recv_bursts.add(size_t(cqe.res));
+				}
+				state.ring.recycle_buffer(id);
+			}
+			if (c.socket == InvalidSocket) continue; //closed while the recv was in flight
+			if (cqe.res > 0) {
+				if (on_event) on_event(&c, Connection::OnRecv);
+			} else if (cqe.res == -ENOBUFS || cqe.res == -ECANCELED) {
+				//ran out of provided buffers; recv is re-armed next poll
+			} else if (cqe.res == -EINVAL && c.uring_recv_multishot) {
+				//kernel doesn't do multishot recv (needs 6.0); fall back to one recv at a time:
+				c.uring_recv_multishot = false;
+			} else {
+				if (cqe.res == 0) {
+					LOG_INFO("[" << where << "] port closed, disconnecting.");
 				} else {
-					std::cerr << "[" << where << "] recv() returned strange number of bytes, disconnecting." << std::endl;
+					LOG_WARN("[" << where << "] recv() returned error " << -cqe.res << "(" << strerror(-cqe.res) << "), disconnecting.");
 				}
 				c.close();
 				if (on_event) on_event(&c, Connection::OnClose);
-				break;
-			} else { //ret > 0
-				c.recv_buffer.insert(c.recv_buffer.end(), buffer, buffer + ret);
-				if (on_event) on_event(&c, Connection::OnRecv);
-				if (ret < BufferSize) break; //ran out of data before buffer: no more data left to read
 			}
+		} else if (op == UringPollOut) {
+			Connection &c = *reinterpret_cast< Connection * >(cqe.user_data & ~uint64_t(UringOpMask));
+			c.uring_pollout_armed = false;
+			c.uring_ops -= 1;
+			c.write_blocked = false;
+			c.mark_pending(); //(to send, or to discard the connection)
+		} else {
+			assert(op == UringCancel);
 		}
 	}
 
-	//process responses:
-	for (auto &c : connections) {
-		//don't bother with connections unless they are valid, have something to send, and are marked writable:
-		if (c.socket == InvalidSocket || c.send_buffer.empty() || !FD_ISSET(c.socket, &write_fds)) continue;
-		
-		#ifdef _WIN32
-		ssize_t ret = send(c.socket, reinterpret_cast< char const * >(c.send_buffer.data()), int(c.send_buffer.size()), MSG_DONTWAIT);
-		#else
-		ssize_t ret = send(c.socket, reinterpret_cast< char const * >(c.send_buffer.data()), c.send_buffer.size(), MSG_DONTWAIT);
-		#endif 
-		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-			//~no problem~, but don't keep trying
-			break;
-		} else if (ret <= 0 || ret > (ssize_t)c.send_buffer.size()) {
-			if (ret < 0) {
-				std::cerr << "[" << where << "] send() returned error " << errno << ", disconnecting." << std::endl;
-			} else { assert(ret == 0 || ret > (ssize_t)c.send_buffer.size());
-				std::cerr << "[" << where << "] send() returned strange number of bytes [" << ret << " of " << c.send_buffer.size() << "], disconnecting." << std::endl;
+	//process responses (and closes):
+	// (handlers called while sending may make more connections pending; they go on a fresh list, for the next poll)
+	std::vector< Connection * > &ready = state.ready;
+	ready.clear();
+	Connection *list = pending;
+	pending = nullptr;
+	while (list) {
+		Connection &c = *list;
+		list = c.pending_next;
+		c.is_pending = false;
+		c.pending_next = nullptr;
+		if (c.socket == InvalidSocket) {
+			//(made pending again as each in-flight operation finishes)
+			if (c.uring_ops > 0) {
+				uring_arm(state, c);
+				continue;
 			}
-			c.close();
-			if (on_event) on_event(&c, Connection::OnClose);
-		} else { //ret seems reasonable
-			c.send_buffer.erase(c.send_buffer.begin(), c.send_buffer.begin() + ret);
+			c.is_pending = true; //(never pending again)
+			c.pending_next = *closed;
+			*closed = &c;
+			continue;
 		}
+		ready.emplace_back(&c);
+	}
+	uring_send_all(where, state, ready, on_event);
+	for (Connection *c : ready) {
+		//(couldn't send everything, or couldn't arm something; try again next poll)
+		if (c->socket != InvalidSocket && uring_needs_poll(*c)) c->mark_pending();
 	}
 
-		
+	return waited;
 }
 
+#endif //CONNECTION_USE_IO_URING
+
 //---------------------------------
 
 
-Server::Server(std::string const &port) {
+Server::Server(std::string const &port) : Server(port, false, "") {
+}
+
+Server::Server(std::string const &port, bool reuse_port, std::string const &host) {
 
 	#ifdef _WIN32
 	{ //init winsock:
@@ -203,12 +832,12 @@ Server::Server(std::string const &port) {
 		hints.ai_flags = AI_PASSIVE;
 
 		struct addrinfo *res = nullptr;
-		int ret = getaddrinfo(NULL, port.c_str(), &hints, &res);
+		int ret = getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints, &res);
 		if (ret != 0) {
 			throw std::runtime_error("getaddrinfo error: " + std::string(gai_strerror(ret)));
 		}
 
-		std::cout << "[Server::Server] binding to " << port << ":" << std::endl;
+		std::cout << "[Server::Server] binding to " << (host.empty() ? "" : host + ":") << port << ":" << std::endl;
 		//based on example code in the 'man getaddrinfo' man page on OSX:
 		for (struct addrinfo *info = res; info != nullptr; info = info->ai_next) {
 			{ //DEBUG: dump info about this address:
@@ -247,6 +876,33 @@ Server::Server(std::string const &port) {
 				}
 			}
 
+			{ //send small messages right away (accepted connections inherit this):
+				#ifdef _WIN32
+				BOOL one = TRUE;
+				int ret = setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast< const char * >(&one), sizeof(one));
+				#else
+				int one = 1;
+				int ret = setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+				#endif
+				if (ret != 0) {
+					std::cout << "[note: couldn't set TCP_NODELAY] " << std::endl;
+				}
+			}
+
+			if (reuse_port) { //let other listen sockets bind the same port:
+				#ifdef SO_REUSEPORT
+				int one = 1;
+				int ret = setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+				if (ret != 0) {
+					closesocket(s);
+					throw std::system_error(errno, std::system_category(), "failed to set SO_REUSEPORT");
+				}
+				#else
+				closesocket(s);
+				throw std::runtime_error("SO_REUSEPORT is not supported on this platform.");
+				#endif
+			}
+
 			int ret = bind(s, info->ai_addr, int(info->ai_addrlen));
 			if (ret < 0) {
 				std::cout << "(failed to bind: " << strerror(errno) << ")" << std::endl;
@@ -272,12 +928,101 @@ Server::Server(std::string const &port) {
 			throw std::system_error(errno, std::system_category(), "failed to listen on socket");
 		}
 	}
+
+	#ifdef CONNECTION_USE_IO_URING
+	try {
+		uring = std::make_shared< UringState >();
+		std::cout << "[Server::Server] using io_uring." << std::endl;
+		return;
+	} catch (std::exception &e) {
+		std::cout << "[Server::Server] io_uring unavailable (" << e.what() << "); falling back to polling." << std::endl;
+	}
+	#endif
+
+	#ifdef CONNECTION_USE_EPOLL
+	{ //watch listen socket with epoll:
+		//edge-triggered accept drains until EAGAIN, so the listen socket must not block:
+		fcntl(listen_socket, F_SETFL, fcntl(listen_socket, F_GETFL, 0) | O_NONBLOCK);
+		epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		if (epoll_fd < 0) {
+			throw std::system_error(errno, std::system_category(), "failed to create epoll instance");
+		}
+		epoll_watch("Server::Server", epoll_fd, listen_socket, nullptr);
+	}
+	#endif
+}
+
+Server::~Server() {
+	for (auto &c : connections) {
+		c.close();
+	}
+	if (listen_socket != InvalidSocket) ::closesocket(listen_socket);
+	#ifdef CONNECTION_USE_EPOLL
+	if (wake_fd >= 0) ::close(wake_fd);
+	if (epoll_fd >= 0) ::close(epoll_fd);
+	#endif
+}
+
+bool Server::enable_wake() {
+	#ifdef CONNECTION_USE_EPOLL
+	if (epoll_fd < 0) return false; //(using io_uring)
+	if (wake_fd >= 0) return true;
+	wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (wake_fd < 0) {
+		LOG_WARN("[Server::enable_wake] eventfd() returned error " << errno << "(" << strerror(errno) << ").");
+		return false;
+	}
+	struct epoll_event evt;
+	memset(&evt, 0, sizeof(evt));
+	evt.events = EPOLLIN | EPOLLET;
+	evt.data.ptr = &WakeMarker;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &evt) != 0) {
+		LOG_WARN("[Server::enable_wake] epoll_ctl() returned error " << errno << "(" << strerror(errno) << ").");
+		::close(wake_fd);
+		wake_fd = -1;
+		return false;
+	}
+	return true;
+	#else
+	return false;
+	#endif
+}
+
+void Server::wake() {
+	#ifdef CONNECTION_USE_EPOLL
+	if (wake_fd < 0) return;
+	uint64_t one = 1;
+	if (::write(wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+		LOG_WARN("[Server::wake] write() to eventfd returned error " << errno << "(" << strerror(errno) << ").");
+	}
+	#endif
 }
 
 void Server::poll(std::function< void(Connection *, Connection::Event event) > const &on_event, double timeout) {
-	poll_connections("Server::poll", connections, on_event, timeout, listen_socket);
+	auto start = std::chrono::steady_clock::now();
+	double waited;
+	Connection *closed = nullptr; //(filled in by the epoll and io_uring backends)
+	#ifdef CONNECTION_USE_IO_URING
+	if (uring) waited = poll_connections("Server::poll", connections, on_event, timeout, *uring, pending, &closed, listen_socket);
+	else
+	#endif
+	#ifdef CONNECTION_USE_EPOLL
+	waited = poll_connections("Server::poll", connections, on_event, timeout, epoll_fd, pending, &closed, wake_fd, listen_socket);
+	#else
+	waited = poll_connections("Server::poll", connections, on_event, timeout, listen_socket);
+	#endif
 
 	//reap closed clients:
+	//(the epoll and io_uring backends list them)
+	while (closed) {
+		auto old = closed->position;
+		closed = closed->pending_next;
+		connections.erase(old);
+	}
+	#ifndef CONNECTION_USE_EPOLL
+	#ifdef CONNECTION_USE_IO_URING
+	if (!uring) //(otherwise, already reaped)
+	#endif
 	for (auto connection = connections.begin(); connection != connections.end(); /*later*/) {
 		auto old = connection;
 		++connection;
@@ -285,6 +1030,9 @@ void Server::poll(std::function< void(Connection *, Connection::Event event) > c
 			connections.erase(old);
 		}
 	}
+	#endif
+
+	record_poll(stats, start, waited);
 }
 
 Client::Client(std::string const &host, std::string const &port) : connections(1), connection(connections.front()) {
@@ -342,6 +1090,19 @@ Client::Client(std::string const &host, std::string const &port) : connections(1
 			}
 			std::cout << "success!" << std::endl;
 
+			{ //send small messages right away:
+				#ifdef _WIN32
+				BOOL one = TRUE;
+				int ret = setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast< const char * >(&one), sizeof(one));
+				#else
+				int one = 1;
+				int ret = setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+				#endif
+				if (ret != 0) {
+					std::cout << "[note: couldn't set TCP_NODELAY] " << std::endl;
+				}
+			}
+
 			connection.socket = s;
 			break;
 		}
@@ -352,10 +1113,56 @@ Client::Client(std::string const &host, std::string const &port) : connections(1
 			throw std::runtime_error("Failed to connect to any of the addresses tried for server.");
 		}
 	}
+
+	//(the epoll and io_uring backends only look at the connection when it is pending; it starts that way, to be set up)
+	connection.pending_list = &pending;
+	connection.mark_pending();
+
+	#ifdef CONNECTION_USE_IO_URING
+	try {
+		uring = std::make_shared< UringState >();
+		std::cout << "[Client::Client] using io_uring." << std::endl;
+		return;
+	} catch (std::exception &e) {
+		std::cout << "[Client::Client] io_uring unavailable (" << e.what() << "); falling back to polling." << std::endl;
+	}
+	#endif
+
+	#ifdef CONNECTION_USE_EPOLL
+	{ //watch connection with epoll:
+		epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		if (epoll_fd < 0) {
+			throw std::system_error(errno, std::system_category(), "failed to create epoll instance");
+		}
+		epoll_watch("Client::Client", epoll_fd, connection.socket, &connection);
+	}
+	#endif
+}
+
+Client::~Client() {
+	connection.close();
+	#ifdef CONNECTION_USE_EPOLL
+	if (epoll_fd >= 0) ::close(epoll_fd);
+	#endif
 }
 
 
 void Client::poll(std::function< void(Connection *, Connection::Event event) > const &on_event, double timeout) {
-	poll_connections("Client::poll", connections, on_event, timeout, InvalidSocket);
+	auto start = std::chrono::steady_clock::now();
+	double waited;
+	#if defined(CONNECTION_USE_EPOLL) || defined(CONNECTION_USE_IO_URING)
+	Connection *closed = nullptr; //(the client's one connection is never discarded)
+	#endif
+	#ifdef CONNECTION_USE_IO_URING
+	if (uring) waited = poll_connections("Client::poll", connections, on_event, timeout, *uring, pending, &closed, InvalidSocket);
+	else
+	#endif
+	#ifdef CONNECTION_USE_EPOLL
+	waited = poll_connections("Client::poll", connections, on_event, timeout, epoll_fd, pending, &closed, -1, InvalidSocket);
+	#else
+	waited = poll_connections("Client::poll", connections, on_event, timeout, InvalidSocket);
+	#endif
+
+	record_poll(stats, start, waited);
 }
 
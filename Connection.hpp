@@ -14,7 +14,7 @@ int main(int argc, char **argv) {
 		server.poll([](Connection *connection, Connection::Event evt){
 			if (evt == Connection::OnRecv) {
 				//extract and erase data from the connection's recv_buffer:
-				std::vector< uint8_t > data = connection->recv_buffer;
+				std::string data = connection->recv_buffer.peek_string(0, connection->recv_buffer.size());
 				connection->recv_buffer.clear();
 				//send to other connections:
 
@@ -60,11 +60,39 @@ int main(int argc, char **argv) {
 #endif
 //--------- ---------------------------------- ---------
 
+//--------- readiness backend used by poll() ---------
+//On linux, poll() uses edge-triggered epoll so that its cost scales with the
+// number of *ready* sockets; elsewhere (or when built with -DCONNECTION_USE_SELECT)
+// it falls back to select(), which is limited to FD_SETSIZE sockets.
+#if defined(__linux__) && !defined(CONNECTION_USE_SELECT)
+	#define CONNECTION_USE_EPOLL 1
+#endif
+//Building with -DCONNECTION_USE_IO_URING (linux 5.19+ only) makes Server and Client
+// do their socket I/O through io_uring instead; if the running kernel can't create a
+// suitable ring they print a note and use epoll (or select) as above.
+#if defined(CONNECTION_USE_IO_URING) && !defined(__linux__)
+	#error "CONNECTION_USE_IO_URING is only supported on linux."
+#endif
+//--------- ---------------------------------- ---------
+
+#include "RingBuffer.hpp"
+#include "Histogram.hpp"
+
 #include <vector>
 #include <list>
+#include <deque>
 #include <string>
+#include <memory>
 #include <functional>
 
+//Immutable, reference-counted bytes that can be queued on many connections at once:
+// (e.g., a broadcast serialized once per tick; must not be modified once queued)
+typedef std::shared_ptr< std::vector< char > const > SharedPayload;
+
+#ifdef CONNECTION_USE_IO_URING
+struct UringState; //(defined in Connection.cpp)
+#endif
+
 //Thin wrapper around a (polling-based) TCP socket connection:
 struct Connection {
 	//Helper that will append any type to the send buffer:
@@ -74,22 +102,100 @@ struct Connection {
 	}
 	//Helper that will append raw bytes to the send buffer:
 	void send_raw(void const *data, size_t size) {
-		send_buffer.insert(send_buffer.end(), reinterpret_cast< uint8_t const * >(data), reinterpret_cast< uint8_t const * >(data) + size);
+		send_buffer.push(data, size);
+		queued();
+	}
+	//Call after appending to send_buffer some other way (e.g., MessageWriter does), so poll() knows there is data to send:
+	void queued() {
+		if (send_queue_size() > send_high_water) send_backed_up = true;
+		mark_pending();
+	}
+	//Queue bytes [begin,end) of a shared payload, after everything queued so far:
+	// (the payload is referenced, not copied, and is written with scatter-gather I/O)
+	void send_shared(SharedPayload const &payload, size_t begin, size_t end);
+	void send_shared(SharedPayload const &payload) {
+		send_shared(payload, 0, payload->size());
+	}
+
+	//Is there anything (in send_buffer or shared slices) waiting to be sent?
+	bool send_pending() const {
+		return !send_buffer.empty() || !send_slices.empty();
+	}
+	//Total bytes (in send_buffer and shared slices) waiting to be sent:
+	size_t send_queue_size() const {
+		return send_buffer.size() + send_slices_size;
 	}
 
+	//Backpressure: once send_queue_size() rises above send_high_water, the connection
+	// counts as backed up until it drains to send_low_water. Nothing is dropped automatically;
+	// code queuing messages can check send_backed_up to hold back or coalesce optional data.
+	// (e.g., ShardedServer keeps only the newest of a series of superseding messages)
+	size_t send_high_water = 64 * 1024;
+	size_t send_low_water = 16 * 1024;
+	bool send_backed_up = false;
+
 	//Call 'close' to mark a connection for discard:
 	void close();
 
 	//so you can if(connection) ... to check for validity:
 	explicit operator bool() { return socket != InvalidSocket; }
 
-	//To send data over a connection, append it to send_buffer:
-	std::vector< char > send_buffer;
+	//Data waiting to be sent; append to it with send(), send_raw(), or a MessageWriter (see Message.hpp) --
+	// anything else that appends to it must call queued() afterward, or poll() may never send it:
+	RingBuffer send_buffer;
 	//When the connection receives data, it is appended to recv_buffer:
-	std::vector< char > recv_buffer;
+	// (consume it with recv_buffer.pop())
+	RingBuffer recv_buffer;
+
+	//Free for whoever owns the connection to name it by (e.g., ShardedServer keeps its ConnectionId here):
+	uint32_t tag = 0;
+
+	//Running totals, kept up to date by poll():
+	struct Stats {
+		uint64_t bytes_in = 0;
+		uint64_t bytes_out = 0;
+		//complete messages received / queued -- only counted by code that frames messages (e.g., ShardedServer):
+		uint64_t messages_in = 0;
+		uint64_t messages_out = 0;
+		size_t send_queue_high_water = 0; //largest send_queue_size() seen when sending
+		uint64_t messages_superseded = 0; //messages dropped (unsent) because a newer one replaced them (e.g., by ShardedServer)
+		Histogram recv_bursts; //bytes received per readiness event
+	} stats;
 
 	//internals:
+	//shared payload slices waiting to be sent, in order:
+	struct SharedSlice {
+		SharedPayload payload;
+		size_t begin = 0, end = 0; //range of payload still to send
+		uint64_t after = 0; //slice goes out once send_buffer_sent reaches this position in the send_buffer byte stream
+	};
+	std::deque< SharedSlice > send_slices;
+	uint64_t send_buffer_sent = 0; //total bytes of send_buffer that have been sent
+	size_t send_slices_size = 0; //total bytes remaining in send_slices
+
 	Socket socket = InvalidSocket;
+	bool write_blocked = false; //(epoll, io_uring) last send() hit EAGAIN; wait for the socket to become writable before trying again
+
+	//(epoll, io_uring) connections with data to send, or that have been closed, are linked into their Server's (or Client's)
+	// pending list, so poll() only visits those and the sockets (or completions) reported ready (select() looks at every connection):
+	Connection **pending_list = nullptr; //head of the list to join (null => not tracked)
+	Connection *pending_next = nullptr;
+	bool is_pending = false; //(on the pending list, or -- once closed -- on the list of connections to discard)
+	void mark_pending() {
+		if (is_pending || !pending_list) return;
+		is_pending = true;
+		pending_next = *pending_list;
+		*pending_list = this;
+	}
+	std::list< Connection >::iterator position; //(epoll, io_uring) where this is in its Server's 'connections', for discarding it
+
+	#ifdef CONNECTION_USE_IO_URING
+	uint32_t uring_ops = 0; //io_uring operations in flight that refer to this connection (it can't be discarded until zero)
+	bool uring_recv_armed = false; //a (multishot) recv is in flight
+	bool uring_recv_multishot = true; //cleared if the kernel rejects multishot recv
+	bool uring_pollout_armed = false; //a POLLOUT poll (for write_blocked) is in flight
+	bool uring_cancel_sent = false; //in-flight operations were cancelled after close()
+	#endif
 
 	enum Event {
 		OnOpen,
@@ -98,8 +204,20 @@ struct Connection {
 	};
 };
 
+//Running totals for a Server or Client's poll() calls:
+struct PollStats {
+	uint64_t polls = 0;
+	Histogram busy_us; //microseconds per poll() spent doing work (i.e., not waiting for events)
+};
+
 struct Server {
 	Server(std::string const &port); //pass the port number to listen on, as a string (servname, really)
+	//reuse_port sets SO_REUSEPORT so several Servers (e.g., one per thread) can share a port, with the kernel spreading connections between them:
+	// (only supported on linux)
+	//if 'host' isn't empty, only listen on that address (e.g., "localhost" for something that shouldn't be reachable from outside)
+	Server(std::string const &port, bool reuse_port, std::string const &host = "");
+	~Server(); //closes the listen socket, every connection, and the epoll instance
+	Server(Server const &) = delete;
 
 	//poll() updates the list of active connections and sends/receives data if possible:
 	// (will wait up to 'timeout' for first event)
@@ -108,13 +226,32 @@ struct Server {
 		double timeout = 0.0 //timeout (seconds)
 	);
 
+	//let other threads cut a poll() short by calling wake():
+	// (only the epoll backend supports this; with the others enable_wake() returns false and wake() does nothing,
+	//  so a caller that needs prompt wakeups should poll with short timeouts instead)
+	bool enable_wake();
+	void wake(); //(thread-safe)
+
 	std::list< Connection > connections;
 	Socket listen_socket = InvalidSocket;
+
+	PollStats stats;
+
+	Connection *pending = nullptr; //(epoll, io_uring) connections with data to send or a close to handle (see Connection::mark_pending())
+	#ifdef CONNECTION_USE_EPOLL
+	int epoll_fd = -1; //epoll instance watching listen_socket and every connection's socket
+	int wake_fd = -1; //eventfd in the epoll set, written by wake() (see enable_wake())
+	#endif
+	#ifdef CONNECTION_USE_IO_URING
+	std::shared_ptr< UringState > uring; //io_uring backend state (null if falling back to epoll)
+	#endif
 };
 
 
 struct Client {
 	Client(std::string const &host, std::string const &port);
+	~Client(); //closes the connection and the epoll instance
+	Client(Client const &) = delete;
 
 	//poll() checks the status of the active connection and sends/receives data if possible:
 	// (will wait up to 'timeout' for first event)
@@ -125,4 +262,14 @@ struct Client {
 
 	std::list< Connection > connections; //will only ever contain exactly one connection
 	Connection &connection; //reference to the only connection in the connections list
+
+	PollStats stats;
+
+	Connection *pending = nullptr; //(see Server::pending)
+	#ifdef CONNECTION_USE_EPOLL
+	int epoll_fd = -1; //epoll instance watching connection.socket
+	#endif
+	#ifdef CONNECTION_USE_IO_URING
+	std::shared_ptr< UringState > uring; //io_uring backend state (null if falling back to epoll)
+	#endif
 };
@@ -0,0 +1,151 @@
+
+//--------- OS-specific socket-related headers ---------
+#ifdef _WIN32
+#define _CRT_SECURE_NO_WARNINGS 1 //so we can use strerror()
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN 1
+#endif
+#undef APIENTRY
+#include <winsock2.h>
+#include <ws2tcpip.h> //for getaddrinfo
+#undef max
+#undef min
+
+#pragma comment(lib, "Ws2_32.lib") //link against the winsock2 library
+
+typedef int ssize_t;
+typedef int socklen_t;
+
+#else
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <fcntl.h>
+
+#define closesocket close
+
+#endif
+
+#include "DatagramSocket.hpp"
+#include "Log.hpp"
+
+//------------------------------------------------------
+
+#include <iostream>
+#include <stdexcept>
+#include <system_error>
+#include <cstring>
+#include <cerrno>
+
+//make a socket's sends and receives return immediately rather than wait:
+static bool set_nonblocking(Socket s) {
+	#ifdef _WIN32
+	unsigned long one = 1;
+	return 0 == ioctlsocket(s, FIONBIO, &one);
+	#else
+	int flags = fcntl(s, F_GETFL, 0);
+	return flags >= 0 && 0 == fcntl(s, F_SETFL, flags | O_NONBLOCK);
+	#endif
+}
+
+DatagramSocket::DatagramSocket(std::string const &port) {
+	#ifdef _WIN32
+	{ //init winsock:
+		WSADATA info;
+		if (WSAStartup((2 << 8) | 2, &info) != 0) {
+			throw std::runtime_error("WSAStartup failed.");
+		}
+	}
+	#endif
+
+	//use getaddrinfo to look up how to bind to port:
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_flags = AI_PASSIVE;
+
+	struct addrinfo *res = nullptr;
+	int ret = getaddrinfo(NULL, port.c_str(), &hints, &res);
+	if (ret != 0) {
+		throw std::runtime_error("getaddrinfo error: " + std::string(gai_strerror(ret)));
+	}
+
+	for (struct addrinfo *info = res; info != nullptr; info = info->ai_next) {
+		Socket s = ::socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+		if (s == InvalidSocket) continue;
+		if (bind(s, info->ai_addr, int(info->ai_addrlen)) < 0 || !set_nonblocking(s)) {
+			closesocket(s);
+			continue;
+		}
+		socket = s;
+		break;
+	}
+
+	freeaddrinfo(res);
+
+	if (socket == InvalidSocket) {
+		throw std::runtime_error("Failed to bind datagram socket to port " + port);
+	}
+	std::cout << "[DatagramSocket::DatagramSocket] receiving datagrams on port " << port << "." << std::endl;
+}
+
+DatagramSocket::DatagramSocket(Connection const &connection) {
+	//find out where the connection goes:
+	struct sockaddr_storage peer;
+	socklen_t peer_size = sizeof(peer);
+	if (connection.socket == InvalidSocket
+	 || getpeername(connection.socket, reinterpret_cast< struct sockaddr * >(&peer), &peer_size) != 0) {
+		throw std::runtime_error("Can't make a datagram socket for a connection that isn't connected.");
+	}
+
+	//and aim a datagram socket at the same place:
+	Socket s = ::socket(peer.ss_family, SOCK_DGRAM, IPPROTO_UDP);
+	if (s == InvalidSocket) {
+		throw std::system_error(errno, std::system_category(), "failed to create datagram socket");
+	}
+	if (connect(s, reinterpret_cast< struct sockaddr * >(&peer), peer_size) != 0 || !set_nonblocking(s)) {
+		int err = errno;
+		closesocket(s);
+		throw std::system_error(err, std::system_category(), "failed to connect datagram socket");
+	}
+	socket = s;
+}
+
+DatagramSocket::~DatagramSocket() {
+	if (socket != InvalidSocket) {
+		::closesocket(socket);
+		socket = InvalidSocket;
+	}
+}
+
+bool DatagramSocket::send(void const *data, size_t size) {
+	ssize_t ret = ::send(socket, reinterpret_cast< char const * >(data), int(size), 0);
+	//NOTE: errors (e.g. ECONNREFUSED from an earlier datagram, or a full send buffer) just mean this datagram is lost.
+	return ret == ssize_t(size);
+}
+
+void DatagramSocket::poll(std::function< void(char const *data, size_t size) > const &on_datagram) {
+	char buffer[MaxSize + 1];
+	while (true) {
+		ssize_t ret = ::recv(socket, buffer, int(sizeof(buffer)), 0);
+		if (ret < 0) {
+			#ifdef _WIN32
+			int err = WSAGetLastError();
+			if (err == WSAEWOULDBLOCK) break;
+			if (err == WSAECONNRESET || err == WSAEMSGSIZE) continue; //(stale ICMP error or oversized datagram)
+			#else
+			if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+			if (errno == ECONNREFUSED || errno == EINTR) continue; //(stale ICMP error)
+			int err = errno;
+			#endif
+			LOG_WARN("[DatagramSocket::poll] recv() returned error " << err << ".");
+			break;
+		}
+		if (size_t(ret) > MaxSize) continue; //too big; was truncated
+		if (on_datagram) on_datagram(buffer, size_t(ret));
+	}
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+/*
+ * DatagramSocket is a simple wrapper around a (non-blocking) UDP socket.
+ *
+ * It's meant to sit next to a TCP Server/Client as an unreliable side channel
+ *  for data that is sent often and is fine to lose (e.g., position updates,
+ *  where a late datagram is superseded by the next one anyway).
+ *
+ * For example:
+
+//server: receive datagrams sent to port 1337
+DatagramSocket datagrams("1337");
+datagrams.poll([](char const *data, size_t size){
+	//...
+});
+
+//client: send datagrams to the same address a Client is connected to
+Client client("localhost", "1337");
+DatagramSocket datagrams(client.connection);
+datagrams.send("hi", 2);
+
+ */
+
+#include "Connection.hpp"
+
+#include <functional>
+#include <string>
+
+struct DatagramSocket {
+	//bind to 'port' (on all addresses) to receive datagrams:
+	DatagramSocket(std::string const &port);
+	//send datagrams to the address + port that 'connection' is connected to:
+	DatagramSocket(Connection const &connection);
+	~DatagramSocket();
+	DatagramSocket(DatagramSocket const &) = delete;
+
+	//send one datagram (only for sockets made from a connection):
+	// returns false if the datagram couldn't be sent -- which, for UDP, is just another way of being lost
+	bool send(void const *data, size_t size);
+
+	//call 'on_datagram' for every datagram that has arrived (never waits):
+	void poll(std::function< void(char const *data, size_t size) > const &on_datagram);
+
+	//largest datagram poll() will deliver intact (anything bigger is truncated and dropped):
+	static constexpr size_t MaxSize = 1200;
+
+	//internals:
+	Socket socket = InvalidSocket;
+};
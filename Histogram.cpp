@@ -0,0 +1,58 @@
+#include "Histogram.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+uint32_t Histogram::bucket_index(uint32_t value) {
+	if (value < SubBuckets) return value;
+	uint32_t msb = 31;
+	while (!(value & (1u << msb))) --msb;
+	uint32_t shift = msb - SubBits;
+	return (shift + 1) * SubBuckets + ((value >> shift) & (SubBuckets - 1));
+}
+
+uint64_t Histogram::bucket_lower(uint32_t index) {
+	if (index < SubBuckets) return index;
+	uint32_t shift = index / SubBuckets - 1;
+	return uint64_t(SubBuckets + index % SubBuckets) << shift;
+}
+
+void Histogram::add(uint64_t value) {
+	value = std::min< uint64_t >(value, 0xffffffff);
+	uint32_t index = bucket_index(uint32_t(value));
+	assert(index < BucketCount);
+	buckets[index] += 1;
+	if (count == 0 || value < min) min = value;
+	if (count == 0 || value > max) max = value;
+	count += 1;
+	sum += value;
+}
+
+void Histogram::merge(Histogram const &other) {
+	if (other.count == 0) return;
+	for (uint32_t i = 0; i < BucketCount; ++i) {
+		buckets[i] += other.buckets[i];
+	}
+	if (count == 0 || other.min < min) min = other.min;
+	if (count == 0 || other.max > max) max = other.max;
+	count += other.count;
+	sum += other.sum;
+}
+
+uint64_t Histogram::percentile(double p) const {
+	if (count == 0) return 0;
+	p = std::max(0.0, std::min(1.0, p));
+	//rank of the sample we're looking for:
+	uint64_t rank = uint64_t(p * double(count - 1)) + 1;
+	uint64_t seen = 0;
+	for (uint32_t i = 0; i < BucketCount; ++i) {
+		seen += buckets[i];
+		if (seen >= rank) {
+			//report the middle of the bucket, kept within the observed range:
+			uint64_t lower = bucket_lower(i);
+			uint64_t upper = (i + 1 < BucketCount ? bucket_lower(i + 1) - 1 : uint64_t(0xffffffff));
+			return std::max(min, std::min(max, lower + (upper - lower) / 2));
+		}
+	}
+	return max;
+}
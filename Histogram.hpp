@@ -0,0 +1,47 @@
+#pragma once
+
+/*
+ * Histogram counts non-negative integer samples (e.g., microseconds or bytes)
+ *  in log-linear buckets: values below 8 are counted exactly, and every
+ *  power-of-two range above that is split into 8 equal buckets, so any
+ *  reported percentile is within 12.5% of the true value.
+ *
+ * It's a fixed-size value type (no allocation), so it's cheap to embed in
+ *  per-connection state and to copy when taking a snapshot.
+ *
+ * For example:
+
+Histogram tick_us;
+tick_us.add(1234);
+tick_us.add(990);
+std::cout << tick_us.percentile(0.99) << std::endl;
+
+ */
+
+#include <cstdint>
+#include <cstddef>
+
+struct Histogram {
+	//record one sample ('value' is clamped to 32 bits):
+	void add(uint64_t value);
+	//add all of 'other''s samples to this histogram:
+	void merge(Histogram const &other);
+	void clear() { *this = Histogram(); }
+
+	//value below which (about) fraction 'p' of samples fall (0 if empty):
+	uint64_t percentile(double p) const;
+	double mean() const { return (count ? double(sum) / double(count) : 0.0); }
+
+	uint64_t count = 0;
+	uint64_t sum = 0;
+	uint64_t min = 0; //(only meaningful if count > 0)
+	uint64_t max = 0;
+
+	//internals:
+	static constexpr uint32_t SubBits = 3; //each power of two is split into 2^SubBits buckets
+	static constexpr uint32_t SubBuckets = 1 << SubBits;
+	static constexpr uint32_t BucketCount = (32 - SubBits + 1) * SubBuckets;
+	static uint32_t bucket_index(uint32_t value);
+	static uint64_t bucket_lower(uint32_t index); //smallest value counted in bucket 'index'
+	uint64_t buckets[BucketCount] = {};
+};
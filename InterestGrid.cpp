@@ -0,0 +1,49 @@
+#include "InterestGrid.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+
+InterestGrid::InterestGrid(glm::vec2 const &min_, glm::vec2 const &max_, float cell_size_) : min(min_), cell_size(cell_size_) {
+	if (!(cell_size > 0.0f)) {
+		throw std::runtime_error("InterestGrid cells must have a positive size.");
+	}
+	//(limit the grid size, so huge boxes or tiny cells don't eat all memory)
+	constexpr float MaxCells = 1024.0f;
+	glm::vec2 size = glm::max(max_ - min_, glm::vec2(0.0f));
+	cells.x = uint32_t(std::min(MaxCells, std::max(1.0f, std::ceil(size.x / cell_size))));
+	cells.y = uint32_t(std::min(MaxCells, std::max(1.0f, std::ceil(size.y / cell_size))));
+	cell_begin.assign(cells.x * cells.y + 1, 0);
+}
+
+glm::uvec2 InterestGrid::cell(glm::vec2 const &at) const {
+	glm::vec2 c = (at - min) / cell_size;
+	//(NaN goes to cell 0)
+	return glm::uvec2(
+		c.x > 0.0f ? uint32_t(std::min(c.x, float(cells.x - 1))) : 0u,
+		c.y > 0.0f ? uint32_t(std::min(c.y, float(cells.y - 1))) : 0u
+	);
+}
+
+void InterestGrid::build(std::vector< glm::vec3 > const &points) {
+	//counting sort by cell:
+	std::fill(cell_begin.begin(), cell_begin.end(), 0);
+	point_cells.resize(points.size());
+	for (uint32_t i = 0; i < points.size(); ++i) {
+		glm::uvec2 c = cell(glm::vec2(points[i]));
+		point_cells[i] = c.y * cells.x + c.x;
+		cell_begin[point_cells[i] + 1] += 1;
+	}
+	for (uint32_t i = 1; i < cell_begin.size(); ++i) {
+		cell_begin[i] += cell_begin[i-1];
+	}
+	indices.resize(points.size());
+	for (uint32_t i = 0; i < points.size(); ++i) {
+		indices[cell_begin[point_cells[i]]++] = i;
+	}
+	//(the fill loop advanced each cell's begin to its end; shift back)
+	for (uint32_t i = uint32_t(cell_begin.size()) - 1; i > 0; --i) {
+		cell_begin[i] = cell_begin[i-1];
+	}
+	cell_begin[0] = 0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+/*
+ * InterestGrid buckets points (e.g., player positions) into a uniform grid
+ *  over the xy plane, so the points near a given position can be found
+ *  without looking at all of them.
+ *
+ * It is rebuilt from scratch each tick (build() is a counting sort, so
+ *  that's cheap), and queries only look at the cells overlapping the query
+ *  circle -- so their cost scales with the number of points nearby rather
+ *  than the total.
+ *
+ * For example:
+
+InterestGrid grid(min, max, radius);
+grid.build(positions);
+grid.query(positions[i], radius, [&](uint32_t j){
+	//positions[j] is in a cell near positions[i]; check the actual distance if it matters
+});
+
+ */
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstdint>
+
+struct InterestGrid {
+	//grid over the box [min, max] (xy only) with square cells of size 'cell_size':
+	// (points outside the box go in the nearest cell)
+	InterestGrid(glm::vec2 const &min, glm::vec2 const &max, float cell_size);
+
+	//put the points in the grid (replacing any from before):
+	void build(std::vector< glm::vec3 > const &points);
+
+	//call 'fn(index)' for every point in the cells within 'radius' (in xy) of 'center':
+	// (so includes every point within 'radius', and some that aren't)
+	template< typename F >
+	void query(glm::vec3 const &center, float radius, F const &fn) const {
+		glm::uvec2 lo = cell(glm::vec2(center) - glm::vec2(radius));
+		glm::uvec2 hi = cell(glm::vec2(center) + glm::vec2(radius));
+		for (uint32_t y = lo.y; y <= hi.y; ++y) {
+			uint32_t begin = cell_begin[y * cells.x + lo.x];
+			uint32_t end = cell_begin[y * cells.x + hi.x + 1];
+			//(cells in a row are contiguous, so this is one run of indices)
+			for (uint32_t i = begin; i < end; ++i) {
+				fn(indices[i]);
+			}
+		}
+	}
+
+	//internals:
+	glm::vec2 min;
+	float cell_size;
+	glm::uvec2 cells; //grid size, in cells
+
+	glm::uvec2 cell(glm::vec2 const &at) const; //(clamped to the grid)
+
+	//points sorted by cell; cell (x,y)'s points are indices[cell_begin[y*cells.x+x], cell_begin[y*cells.x+x+1]):
+	std::vector< uint32_t > cell_begin;
+	std::vector< uint32_t > indices;
+	std::vector< uint32_t > point_cells; //(scratch space for build())
+};
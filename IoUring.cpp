@@ -0,0 +1,206 @@
+//(only built along with the io_uring backend -- see CONNECTION_USE_IO_URING in Connection.hpp)
+#ifdef CONNECTION_USE_IO_URING
+
+#include "IoUring.hpp"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include <system_error>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <cassert>
+
+//io_uring indices are shared with the kernel; read/write them with the appropriate barriers:
+static inline uint32_t load_acquire(uint32_t const *p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static inline void store_release(uint32_t *p, uint32_t v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+
+IoUring::IoUring(uint32_t entries, uint32_t buffer_count, uint32_t buffer_size_) : buffer_size(buffer_size_) {
+	assert(buffer_count > 0 && (buffer_count & (buffer_count - 1)) == 0 && buffer_count <= 32768);
+
+	io_uring_params params;
+	std::memset(&params, 0, sizeof(params));
+	fd = int(syscall(__NR_io_uring_setup, entries, &params));
+	if (fd < 0) {
+		throw std::system_error(errno, std::system_category(), "io_uring_setup failed");
+	}
+	features = params.features;
+
+	//the backend relies on: extended-argument waits (5.11) and no dropped completions (5.5):
+	if (!(features & IORING_FEAT_EXT_ARG) || !(features & IORING_FEAT_NODROP)) {
+		::close(fd);
+		throw std::runtime_error("io_uring is missing required features (needs linux 5.11+)");
+	}
+
+	{ //map queues:
+		sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+		cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		if (features & IORING_FEAT_SINGLE_MMAP) {
+			sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+		}
+		sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+		if (sq_ring == MAP_FAILED) {
+			int err = errno;
+			::close(fd);
+			throw std::system_error(err, std::system_category(), "failed to map io_uring submission queue");
+		}
+		if (features & IORING_FEAT_SINGLE_MMAP) {
+			cq_ring = sq_ring;
+		} else {
+			cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+			if (cq_ring == MAP_FAILED) {
+				int err = errno;
+				munmap(sq_ring, sq_ring_size);
+				::close(fd);
+				throw std::system_error(err, std::system_category(), "failed to map io_uring completion queue");
+			}
+		}
+		sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+		sqes = reinterpret_cast< io_uring_sqe * >(mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+		if (sqes == MAP_FAILED) {
+			int err = errno;
+			if (cq_ring != sq_ring) munmap(cq_ring, cq_ring_size);
+			munmap(sq_ring, sq_ring_size);
+			::close(fd);
+			throw std::system_error(err, std::system_category(), "failed to map io_uring submission entries");
+		}
+
+		char *sq = reinterpret_cast< char * >(sq_ring);
+		sq_head = reinterpret_cast< uint32_t * >(sq + params.sq_off.head);
+		sq_tail = reinterpret_cast< uint32_t * >(sq + params.sq_off.tail);
+		sq_array = reinterpret_cast< uint32_t * >(sq + params.sq_off.array);
+		sq_mask = *reinterpret_cast< uint32_t * >(sq + params.sq_off.ring_mask);
+		sq_entries = *reinterpret_cast< uint32_t * >(sq + params.sq_off.ring_entries);
+		sq_local_tail = *sq_tail;
+
+		char *cq = reinterpret_cast< char * >(cq_ring);
+		cq_head = reinterpret_cast< uint32_t * >(cq + params.cq_off.head);
+		cq_tail = reinterpret_cast< uint32_t * >(cq + params.cq_off.tail);
+		cq_mask = *reinterpret_cast< uint32_t * >(cq + params.cq_off.ring_mask);
+		cqes = reinterpret_cast< io_uring_cqe * >(cq + params.cq_off.cqes);
+	}
+
+	{ //register provided buffer ring (5.19+):
+		buf_ring_size = buffer_count * sizeof(io_uring_buf);
+		void *mem = mmap(nullptr, buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mem == MAP_FAILED) {
+			int err = errno;
+			release();
+			throw std::system_error(err, std::system_category(), "failed to allocate io_uring buffer ring");
+		}
+		buf_ring = reinterpret_cast< io_uring_buf_ring * >(mem);
+		buf_mask = buffer_count - 1;
+
+		io_uring_buf_reg reg;
+		std::memset(&reg, 0, sizeof(reg));
+		reg.ring_addr = reinterpret_cast< uint64_t >(buf_ring);
+		reg.ring_entries = buffer_count;
+		reg.bgid = BufferGroup;
+		if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+			int err = errno;
+			release();
+			throw std::system_error(err, std::system_category(), "failed to register io_uring buffer ring (needs linux 5.19+)");
+		}
+
+		buffers.resize(size_t(buffer_count) * buffer_size);
+		buf_ring->tail = 0;
+		for (uint32_t i = 0; i < buffer_count; ++i) {
+			recycle_buffer(uint16_t(i));
+		}
+	}
+}
+
+IoUring::~IoUring() {
+	release();
+}
+
+void IoUring::release() {
+	if (buf_ring) munmap(buf_ring, buf_ring_size);
+	buf_ring = nullptr;
+	if (sqes) munmap(sqes, sqes_size);
+	sqes = nullptr;
+	if (cq_ring && cq_ring != sq_ring) munmap(cq_ring, cq_ring_size);
+	cq_ring = nullptr;
+	if (sq_ring) munmap(sq_ring, sq_ring_size);
+	sq_ring = nullptr;
+	if (fd >= 0) ::close(fd);
+	fd = -1;
+}
+
+uint32_t IoUring::queued() const {
+	return sq_local_tail - *sq_tail;
+}
+
+int IoUring::enter(uint32_t to_submit, uint32_t wait_for, uint32_t flags, void *arg, size_t arg_size) {
+	return int(syscall(__NR_io_uring_enter, fd, to_submit, wait_for, flags, arg, arg_size));
+}
+
+io_uring_sqe *IoUring::get_sqe() {
+	if (sq_local_tail - load_acquire(sq_head) >= sq_entries) {
+		//queue is full; push what's there to the kernel:
+		submit_and_wait(0);
+		if (sq_local_tail - load_acquire(sq_head) >= sq_entries) return nullptr;
+	}
+	uint32_t index = sq_local_tail & sq_mask;
+	io_uring_sqe *sqe = &sqes[index];
+	std::memset(sqe, 0, sizeof(*sqe));
+	sq_array[index] = index;
+	sq_local_tail += 1;
+	return sqe;
+}
+
+bool IoUring::submit_and_wait(uint32_t wait_for, double timeout) {
+	uint32_t to_submit = queued();
+	store_release(sq_tail, sq_local_tail); //publish prepared entries
+
+	if (to_submit == 0 && wait_for == 0) return true;
+
+	uint32_t flags = 0;
+	if (wait_for > 0) flags |= IORING_ENTER_GETEVENTS;
+
+	__kernel_timespec ts;
+	io_uring_getevents_arg arg;
+	std::memset(&arg, 0, sizeof(arg));
+	if (wait_for > 0 && timeout >= 0.0) {
+		ts.tv_sec = int64_t(std::floor(timeout));
+		ts.tv_nsec = int64_t((timeout - std::floor(timeout)) * 1e9);
+		arg.ts = reinterpret_cast< uint64_t >(&ts);
+		flags |= IORING_ENTER_EXT_ARG;
+	}
+
+	int ret;
+	if (flags & IORING_ENTER_EXT_ARG) {
+		ret = enter(to_submit, wait_for, flags, &arg, sizeof(arg));
+	} else {
+		ret = enter(to_submit, wait_for, flags, nullptr, _NSIG / 8);
+	}
+	if (ret >= 0) return true;
+	if (errno == ETIME || errno == EINTR) return true;
+	//kernel is short on resources / completion space; let the caller drain completions:
+	if (errno == EAGAIN || errno == EBUSY) return true;
+	return false;
+}
+
+bool IoUring::pop_cqe(io_uring_cqe *cqe) {
+	uint32_t head = *cq_head;
+	if (head == load_acquire(cq_tail)) return false;
+	*cqe = cqes[head & cq_mask];
+	store_release(cq_head, head + 1);
+	return true;
+}
+
+void IoUring::recycle_buffer(uint16_t id) {
+	uint16_t tail = buf_ring->tail;
+	//NOTE: not buf_ring->bufs[], since in C++ the header's flexible-array wrapper can shift 'bufs' off the start of the ring:
+	io_uring_buf &buf = reinterpret_cast< io_uring_buf * >(buf_ring)[tail & buf_mask];
+	buf.addr = reinterpret_cast< uint64_t >(buffer(id));
+	buf.len = buffer_size;
+	buf.bid = id;
+	__atomic_store_n(&buf_ring->tail, uint16_t(tail + 1), __ATOMIC_RELEASE);
+}
+
+#endif //CONNECTION_USE_IO_URING
@@ -0,0 +1,75 @@
+#pragma once
+
+/*
+ * IoUring is a minimal wrapper around a linux io_uring instance, made with
+ *  raw syscalls (no liburing dependency). It is used by the io_uring backend
+ *  of Server::poll / Client::poll (see Connection.cpp).
+ *
+ * Besides the submission and completion queues, it registers a ring of
+ *  "provided buffers" (IORING_REGISTER_PBUF_RING) that recv operations
+ *  submitted with IOSQE_BUFFER_SELECT pick buffers from.
+ *
+ * The constructor throws if the running kernel doesn't support the
+ *  features used (linux 5.19 or newer is needed), so callers can fall back
+ *  to another backend.
+ *
+ */
+
+#include <linux/io_uring.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+struct IoUring {
+	//entries: submission queue size; buffer_count (a power of two) x buffer_size: provided recv buffers
+	IoUring(uint32_t entries, uint32_t buffer_count, uint32_t buffer_size);
+	~IoUring();
+	IoUring(IoUring const &) = delete;
+
+	//get a cleared submission queue entry:
+	// (if the queue is full, submits what's queued to make room)
+	io_uring_sqe *get_sqe();
+
+	//submit queued entries, then wait until at least 'wait_for' completions are available:
+	// gives up after 'timeout' seconds (negative means no timeout)
+	// returns false on error (other than timeout / interruption)
+	bool submit_and_wait(uint32_t wait_for, double timeout = -1.0);
+
+	//remove the oldest completion from the completion queue; returns false if none:
+	bool pop_cqe(io_uring_cqe *cqe);
+
+	//provided buffers:
+	static constexpr uint16_t BufferGroup = 0;
+	uint32_t buffer_size = 0;
+	char *buffer(uint16_t id) { return buffers.data() + size_t(id) * buffer_size; }
+	//hand a provided buffer back to the kernel once its contents have been consumed:
+	void recycle_buffer(uint16_t id);
+
+	//internals:
+	int fd = -1;
+	uint32_t features = 0;
+
+	void *sq_ring = nullptr;
+	size_t sq_ring_size = 0;
+	void *cq_ring = nullptr;
+	size_t cq_ring_size = 0;
+	io_uring_sqe *sqes = nullptr;
+	size_t sqes_size = 0;
+
+	uint32_t *sq_head = nullptr, *sq_tail = nullptr, *sq_array = nullptr;
+	uint32_t sq_mask = 0, sq_entries = 0;
+	uint32_t sq_local_tail = 0; //entries prepared but not yet submitted end here
+	uint32_t *cq_head = nullptr, *cq_tail = nullptr;
+	uint32_t cq_mask = 0;
+	io_uring_cqe *cqes = nullptr;
+
+	io_uring_buf_ring *buf_ring = nullptr;
+	size_t buf_ring_size = 0;
+	uint32_t buf_mask = 0;
+	std::vector< char > buffers;
+
+	uint32_t queued() const; //prepared but unsubmitted entries
+	void release(); //unmap and close everything (used by destructor and failed constructor)
+	int enter(uint32_t to_submit, uint32_t wait_for, uint32_t flags, void *arg, size_t arg_size);
+};
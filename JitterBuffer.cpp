@@ -0,0 +1,89 @@
+#include "JitterBuffer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+//how fast the playout offset approaches its target (fraction of the difference per second) when growing and when shrinking:
+static constexpr double GrowRate = 10.0;
+static constexpr double ShrinkRate = 0.5;
+//(growing slows the shown time down; this keeps it from running backward)
+static constexpr double MaxGrowth = 0.5; //seconds per second
+
+double JitterBuffer::received(uint32_t sequence, Clock::time_point when) {
+	if (!started) {
+		started = true;
+		epoch = when;
+		last_sequence = sequence;
+	}
+	//(unwrap, relative to the newest sequence so far)
+	int64_t unwrapped = last_sequence + int32_t(sequence - uint32_t(last_sequence));
+	last_sequence = std::max(last_sequence, unwrapped);
+
+	double server = double(unwrapped) * tick_period;
+	double local = std::chrono::duration< double >(when - epoch).count();
+	arrivals.emplace_back(Arrival{local, local - server});
+	while (arrivals.front().local < local - Window) arrivals.pop_front();
+
+	//lateness of each arrival relative to the earliest:
+	base = arrivals.front().offset;
+	for (Arrival const &arrival : arrivals) base = std::min(base, arrival.offset);
+	lateness.clear();
+	for (Arrival const &arrival : arrivals) lateness.emplace_back(arrival.offset - base);
+	auto p95 = lateness.begin() + (lateness.size() * 95) / 100;
+	if (p95 == lateness.end()) --p95;
+	std::nth_element(lateness.begin(), p95, lateness.end());
+	jitter = *p95;
+
+	target_delay = tick_period + jitter + Margin;
+	if (arrivals.size() == 1 && playout == 0.0) playout = base + target_delay;
+
+	return server;
+}
+
+double JitterBuffer::render_time(Clock::time_point now) {
+	if (!started) return 0.0;
+	double local = std::chrono::duration< double >(now - epoch).count();
+	double elapsed = std::max(0.0, local - last_render);
+	last_render = local;
+
+	double target = base + target_delay;
+	if (target > playout) {
+		playout += std::min((target - playout) * std::min(1.0, elapsed * GrowRate), elapsed * MaxGrowth);
+	} else {
+		playout += (target - playout) * std::min(1.0, elapsed * ShrinkRate);
+	}
+	delay = playout - base;
+
+	return local - playout;
+}
+
+//------------------------------------
+
+void PositionTrack::add(double time, glm::vec3 const &position) {
+	if (!samples.empty() && time <= samples.back().time) return;
+	samples.emplace_back(Sample{time, position});
+	while (samples.size() > MaxSamples) samples.pop_front();
+}
+
+glm::vec3 PositionTrack::sample(double time, double max_extrapolation) const {
+	if (samples.empty()) return glm::vec3(0.0f);
+	if (time <= samples.front().time) return samples.front().position;
+
+	//newest sample at or before 'time' (usually one of the last few):
+	size_t i = samples.size() - 1;
+	while (samples[i].time > time) --i;
+
+	if (i + 1 < samples.size()) {
+		Sample const &a = samples[i];
+		Sample const &b = samples[i + 1];
+		float t = float((time - a.time) / (b.time - a.time));
+		return glm::mix(a.position, b.position, t);
+	}
+
+	//past the newest sample; keep going the way it was going, for a little while:
+	Sample const &last = samples.back();
+	if (samples.size() < 2) return last.position;
+	Sample const &before = samples[samples.size() - 2];
+	glm::vec3 velocity = (last.position - before.position) / float(last.time - before.time);
+	return last.position + velocity * float(std::min(time - last.time, max_extrapolation));
+}
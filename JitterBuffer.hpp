@@ -0,0 +1,95 @@
+#pragma once
+
+/*
+ * JitterBuffer decides how far in the past the client shows other players,
+ *  so that their motion doesn't depend on exactly when snapshots arrive.
+ *
+ * Snapshots are placed on the server's timeline -- snapshot sequence times
+ *  the server's tick period (from its 't' message; see Protocol.hpp) -- and
+ *  the client shows that timeline at a delay behind the (estimated) newest
+ *  possible snapshot, just big enough that there is usually a snapshot on
+ *  either side of the time being shown:
+ *   delay = tick period + (95th percentile of recent arrival lateness) + a little
+ *  Arrival lateness is measured against the earliest arrival (relative to
+ *  its server time) in the last Window seconds, so slow drift between the
+ *  clocks (or ticks the server skipped) is tracked too. The shown time
+ *  falls back quickly when jitter goes up (but never runs backward) and
+ *  catches up slowly when it goes down, so it never jumps.
+ *
+ * PositionTrack keeps a short history of one player's positions on that
+ *  timeline and returns the position at the shown time: interpolated
+ *  between snapshots, or extrapolated (for at most max_extrapolation
+ *  seconds past the newest one) when snapshots are late.
+ *
+ * For example:
+
+JitterBuffer jitter;
+jitter.tick_period = 1.0 / server_tick_rate;
+//for every snapshot, in order:
+double time = jitter.received(snapshot.sequence, arrival_time);
+for (auto const &player : snapshot.players) tracks[player.id].add(time, player.position);
+//every frame:
+double show = jitter.render_time(JitterBuffer::Clock::now());
+for (auto &track : tracks) drawable.position = track.sample(show, 0.1);
+
+ */
+
+#include <glm/glm.hpp>
+
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <cstdint>
+
+struct JitterBuffer {
+	typedef std::chrono::steady_clock Clock;
+
+	//note that snapshot 'sequence' arrived at 'when'; returns its time on the server's timeline (seconds):
+	double received(uint32_t sequence, Clock::time_point when);
+
+	//the time on the server's timeline to show at 'now':
+	double render_time(Clock::time_point now);
+
+	double tick_period = 1.0 / 30.0; //seconds between server ticks (set from the server's 't' message)
+	static constexpr double Window = 2.0; //seconds of arrivals considered
+	static constexpr double Margin = 0.002; //extra delay (seconds), for timer slop
+
+	//current estimates (seconds):
+	double jitter = 0.0; //95th percentile of arrival lateness
+	double delay = 0.0; //how far behind the newest possible snapshot render_time() is (as of the last call)
+
+	//internals:
+	struct Arrival {
+		double local; //arrival time (seconds since 'epoch')
+		double offset; //local - server time
+	};
+	std::deque< Arrival > arrivals; //(last Window seconds)
+	std::vector< double > lateness; //(scratch space for the percentile)
+	double base = 0.0; //smallest offset in 'arrivals'
+	double target_delay = 0.0;
+	double playout = 0.0; //local time - shown time (approaches base + target_delay)
+	Clock::time_point epoch;
+	double last_render = 0.0; //(local time of the last render_time() call, to smooth 'delay')
+	bool started = false;
+	int64_t last_sequence = 0; //(sequences, unwrapped)
+};
+
+struct PositionTrack {
+	//add a position at 'time' (samples must arrive in time order; others are ignored):
+	void add(double time, glm::vec3 const &position);
+	//forget all positions (e.g., the player was out of view for a while):
+	void clear() { samples.clear(); }
+	bool empty() const { return samples.empty(); }
+
+	//position at 'time' (before the first sample => the first sample):
+	glm::vec3 sample(double time, double max_extrapolation) const;
+
+	static constexpr size_t MaxSamples = 32;
+
+	//internals:
+	struct Sample {
+		double time;
+		glm::vec3 position;
+	};
+	std::deque< Sample > samples;
+};
@@ -0,0 +1,213 @@
+#include "Log.hpp"
+
+#include "SPSCQueue.hpp"
+#include "hex_dump.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+std::atomic< int > Log::current_level{Log::Info};
+
+namespace {
+	//lines each thread can have waiting for the writer:
+	constexpr size_t QueueSize = 4096;
+	//the writer sleeps until a line is queued (see Writer::sleeping), but checks this often anyway (seconds):
+	constexpr double IdleTimeout = 1.0;
+
+	typedef std::chrono::steady_clock Clock;
+
+	struct Record {
+		Log::Level level = Log::Info;
+		Clock::time_point time;
+		std::string text;
+		std::vector< char > bytes; //(hex dumped after text, if not empty)
+	};
+
+	struct ThreadQueue {
+		ThreadQueue(uint32_t thread_) : queue(QueueSize), thread(thread_) { }
+		SPSCQueue< Record > queue;
+		uint32_t thread; //(number shown in each line)
+		std::atomic< bool > retired{false}; //thread has exited (queue is dropped once empty)
+	};
+
+	struct Writer {
+		Writer() : start(Clock::now()) {
+			thread = std::thread([this](){ run(); });
+		}
+		~Writer() {
+			stop = true;
+			wake();
+			if (thread.joinable()) thread.join();
+		}
+
+		//wake the writer thread if it is sleeping:
+		// (loggers call this after queuing a line; pairs with the fence in run())
+		void wake() {
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			if (sleeping.load(std::memory_order_relaxed) && sleeping.exchange(false)) {
+				std::lock_guard< std::mutex > lock(sleep_mutex);
+				woken.notify_one();
+			}
+		}
+
+		//register a queue for the calling thread:
+		std::shared_ptr< ThreadQueue > add_queue() {
+			std::unique_lock< std::mutex > lock(mutex);
+			queues.emplace_back(std::make_shared< ThreadQueue >(next_thread++));
+			return queues.back();
+		}
+
+		void run() {
+			std::vector< std::shared_ptr< ThreadQueue > > current;
+			std::string out;
+			while (true) {
+				bool stopping = stop.load();
+				{ //pick up new queues and drop empty ones from exited threads:
+					std::unique_lock< std::mutex > lock(mutex);
+					for (auto q = queues.begin(); q != queues.end(); ) {
+						if ((*q)->retired.load() && (*q)->queue.size() == 0) q = queues.erase(q);
+						else ++q;
+					}
+					current = queues;
+				}
+
+				out.clear();
+				Record record;
+				for (auto const &q : current) {
+					while (q->queue.try_pop(&record)) {
+						format(q->thread, record, &out);
+					}
+				}
+				if (!out.empty()) {
+					std::fwrite(out.data(), 1, out.size(), stderr);
+					std::fflush(stderr);
+				}
+				passes.fetch_add(1);
+
+				if (stopping) break;
+				if (out.empty()) { //nothing to do; sleep until a line is queued:
+					std::unique_lock< std::mutex > lock(sleep_mutex);
+					//announce the sleep, then re-check every queue (including ones added since this pass):
+					sleeping.store(true, std::memory_order_relaxed);
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+					if (!stop.load() && !anything_queued()) {
+						woken.wait_for(lock, std::chrono::duration< double >(IdleTimeout), [this](){ return !sleeping.load(); });
+					}
+					sleeping.store(false, std::memory_order_relaxed);
+				}
+			}
+		}
+
+		bool anything_queued() {
+			std::unique_lock< std::mutex > lock(mutex);
+			for (auto const &q : queues) {
+				if (q->queue.size() != 0) return true;
+			}
+			return false;
+		}
+
+		void format(uint32_t thread, Record const &record, std::string *out) {
+			static char const *names[] = { "T", "D", "I", "W", "E", "-" };
+			char prefix[64];
+			std::snprintf(prefix, sizeof(prefix), "[%10.6f %s %u] ",
+				std::chrono::duration< double >(record.time - start).count(),
+				names[record.level >= Log::Trace && record.level <= Log::Off ? record.level : Log::Off],
+				thread);
+			*out += prefix;
+			*out += record.text;
+			*out += '\n';
+			if (!record.bytes.empty()) *out += hex_dump(record.bytes);
+		}
+
+		Clock::time_point start;
+		std::mutex mutex; //guards 'queues' and 'next_thread' (taken by the writer once per pass, and by threads logging for the first time)
+		std::vector< std::shared_ptr< ThreadQueue > > queues;
+		uint32_t next_thread = 0;
+		std::atomic< bool > stop{false};
+		std::atomic< uint64_t > passes{0}; //(writer passes completed, for flush())
+		std::atomic< uint64_t > dropped{0};
+		std::atomic< bool > sleeping{false}; //writer is (about to be) waiting on 'woken'
+		std::mutex sleep_mutex; //(only taken to sleep, and to wake a sleeping writer)
+		std::condition_variable woken;
+		std::thread thread;
+	};
+
+	Writer &writer() {
+		static Writer writer;
+		return writer;
+	}
+
+	//each thread's queue, registered the first time the thread logs:
+	struct ThreadHandle {
+		~ThreadHandle() {
+			if (queue) queue->retired = true;
+		}
+		std::shared_ptr< ThreadQueue > queue;
+	};
+	thread_local ThreadHandle handle;
+
+	//LOG_LEVEL from the environment, if set:
+	bool const level_from_environment = [](){
+		char const *name = std::getenv("LOG_LEVEL");
+		Log::Level level;
+		if (name && Log::parse_level(name, &level)) {
+			Log::set_level(level);
+			return true;
+		}
+		return false;
+	}();
+}
+
+void Log::set_level(Level level) {
+	current_level.store(level, std::memory_order_relaxed);
+}
+
+bool Log::parse_level(std::string const &name, Level *level) {
+	if (name == "trace") *level = Trace;
+	else if (name == "debug") *level = Debug;
+	else if (name == "info") *level = Info;
+	else if (name == "warn") *level = Warn;
+	else if (name == "error") *level = Error;
+	else if (name == "off") *level = Off;
+	else return false;
+	return true;
+}
+
+void Log::write(Level level, std::string &&text, void const *bytes, size_t size) {
+	Writer &w = writer();
+	if (!handle.queue) handle.queue = w.add_queue();
+
+	Record record;
+	record.level = level;
+	record.time = Clock::now();
+	record.text = std::move(text);
+	if (size) record.bytes.assign(reinterpret_cast< char const * >(bytes), reinterpret_cast< char const * >(bytes) + size);
+	if (!handle.queue->queue.try_push(std::move(record))) {
+		w.dropped.fetch_add(1, std::memory_order_relaxed);
+	}
+	w.wake();
+}
+
+void Log::flush() {
+	Writer &w = writer();
+	//wait for the queues to empty, then for the writer to finish the pass that emptied them:
+	// (waking the writer each time, since it may have gone to sleep in between)
+	while (w.anything_queued()) {
+		w.wake();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	uint64_t passes = w.passes.load();
+	while (w.passes.load() < passes + 2) {
+		w.wake();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+uint64_t Log::dropped() {
+	return writer().dropped.load(std::memory_order_relaxed);
+}
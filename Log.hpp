@@ -0,0 +1,101 @@
+#pragma once
+
+/*
+ * Log is an asynchronous logger for diagnostics that happen on hot paths
+ *  (e.g., per-message or per-connection events).
+ *
+ * Each thread that logs gets its own lock-free queue (an SPSCQueue, found
+ *  through a thread_local), and a background writer thread drains all of
+ *  them to stderr (sleeping while they are empty). So logging a line costs
+ *  formatting it (on the calling thread) and a queue push -- no locks and no
+ *  console I/O, and a wakeup only when the writer is asleep. Raw bytes can be
+ *  attached to a line (LOG_HEX); they are copied, and hex-dumped by the
+ *  writer thread.
+ * If a thread's queue is full, its lines are dropped (and counted) rather
+ *  than waiting.
+ *
+ * Levels are filtered twice:
+ *  - at compile time: lines below LOG_MIN_LEVEL (default: Debug) compile to
+ *    nothing (so build with -DLOG_MIN_LEVEL=0 to get Trace lines);
+ *  - at run time: lines below Log::level() (default: Info; set with the
+ *    LOG_LEVEL environment variable, e.g. LOG_LEVEL=debug, or set_level())
+ *    cost one branch.
+ *
+ * Lines from one thread come out in order; lines from different threads may
+ *  interleave slightly out of order (each has a timestamp).
+ *
+ * For example:
+
+LOG_INFO("client connected on " << socket << ".");
+LOG_HEX(Log::Debug, "got bytes:", data, size);
+if (Log::enabled(Log::Debug)) { ...expensive check... }
+
+ */
+
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 1
+#endif
+
+namespace Log {
+	enum Level : int {
+		Trace = 0,
+		Debug = 1,
+		Info = 2,
+		Warn = 3,
+		Error = 4,
+		Off = 5,
+	};
+
+	//lines below this level are dropped at run time:
+	extern std::atomic< int > current_level;
+	inline Level level() { return Level(current_level.load(std::memory_order_relaxed)); }
+	void set_level(Level level);
+	//parse "trace", "debug", "info", "warn", "error", or "off" (returns false for anything else):
+	bool parse_level(std::string const &name, Level *level);
+
+	inline bool enabled(Level level) {
+		return level >= LOG_MIN_LEVEL && level >= current_level.load(std::memory_order_relaxed);
+	}
+
+	//queue a line (and, optionally, bytes to hex dump after it) for the writer thread:
+	void write(Level level, std::string &&text, void const *bytes = nullptr, size_t size = 0);
+
+	//wait until every line queued so far (by any thread) has been written:
+	void flush();
+
+	//lines dropped because a queue was full:
+	uint64_t dropped();
+}
+
+//LOG_*(stream expression), e.g. LOG_WARN("recv() returned error " << err << "."):
+#define LOG_AT(LEVEL, EXPR) \
+	do { \
+		if (Log::enabled(LEVEL)) { \
+			std::ostringstream log_line_; \
+			log_line_ << EXPR; \
+			Log::write(LEVEL, log_line_.str()); \
+		} \
+	} while (0)
+
+//LOG_HEX(level, stream expression, data, size) logs a line followed by a hex dump of [data, data+size):
+#define LOG_HEX(LEVEL, EXPR, DATA, SIZE) \
+	do { \
+		if (Log::enabled(LEVEL)) { \
+			std::ostringstream log_line_; \
+			log_line_ << EXPR; \
+			Log::write(LEVEL, log_line_.str(), (DATA), (SIZE)); \
+		} \
+	} while (0)
+
+#define LOG_TRACE(EXPR) LOG_AT(Log::Trace, EXPR)
+#define LOG_DEBUG(EXPR) LOG_AT(Log::Debug, EXPR)
+#define LOG_INFO(EXPR) LOG_AT(Log::Info, EXPR)
+#define LOG_WARN(EXPR) LOG_AT(Log::Warn, EXPR)
+#define LOG_ERROR(EXPR) LOG_AT(Log::Error, EXPR)
@@ -0,0 +1,204 @@
+#include "Message.hpp"
+#include "Compress.hpp"
+#include "Connection.hpp"
+
+#include <algorithm>
+
+size_t encode_varint(char *dst, uint32_t value) {
+	size_t size = 0;
+	while (value >= 0x80) {
+		dst[size++] = char(uint8_t(value & 0x7f) | 0x80);
+		value >>= 7;
+	}
+	dst[size++] = char(uint8_t(value));
+	return size;
+}
+
+size_t encode_message_header(char *dst, char type, uint32_t payload_size) {
+	dst[0] = type;
+	return 1 + encode_varint(dst + 1, payload_size);
+}
+
+//parse a header from bytes available through 'get(i)' (i < available):
+template< typename Get >
+static MessageStatus parse_header(Get const &get, size_t available, MessageHeader *header_, uint32_t max_payload) {
+	assert(header_);
+	MessageHeader &header = *header_;
+	if (available < 2) return MessageIncomplete;
+	header.type = get(0);
+	uint32_t value = 0;
+	for (uint32_t i = 0; i < 5; ++i) {
+		if (1 + i >= available) return MessageIncomplete;
+		uint8_t byte = uint8_t(get(1 + i));
+		if (i == 4 && byte > 0x0f) return MessageMalformed; //doesn't fit in 32 bits
+		value |= uint32_t(byte & 0x7f) << (7 * i);
+		if (!(byte & 0x80)) {
+			if (value > max_payload) return MessageMalformed;
+			header.header_size = 2 + i;
+			header.payload_size = value;
+			return (available >= header.total_size() ? MessageComplete : MessageIncomplete);
+		}
+	}
+	return MessageMalformed; //varint longer than five bytes
+}
+
+MessageStatus peek_message(RingBuffer const &buffer, size_t offset, MessageHeader *header, uint32_t max_payload) {
+	assert(offset <= buffer.size());
+	return parse_header([&](size_t i) { return buffer[offset + i]; }, buffer.size() - offset, header, max_payload);
+}
+
+//------------------------------------
+
+MessageReader::MessageReader(RingBuffer &buffer, MessageHeader const &header_, size_t offset) : header(header_) {
+	assert(offset + header.total_size() <= buffer.size());
+	size = header.payload_size;
+	buffer.peek_spans(offset + header.header_size, size, spans);
+}
+
+MessageReader::MessageReader(char const *data, size_t size_) {
+	MessageStatus status = parse_header([&](size_t i) { return data[i]; }, size_, &header, DefaultMaxMessagePayload);
+	if (status != MessageComplete || header.total_size() != size_) {
+		failed = true;
+		return;
+	}
+	size = header.payload_size;
+	spans[0].data = const_cast< char * >(data) + header.header_size;
+	spans[0].size = size;
+}
+
+bool MessageReader::read(void *dst_, size_t count) {
+	RingBuffer::Span got[2];
+	uint32_t got_count = read_spans(count, got);
+	if (count > 0 && got_count == 0) return false;
+	char *dst = reinterpret_cast< char * >(dst_);
+	for (uint32_t i = 0; i < got_count; ++i) {
+		std::memcpy(dst, got[i].data, got[i].size);
+		dst += got[i].size;
+	}
+	return true;
+}
+
+bool MessageReader::read_varint(uint32_t *value_) {
+	assert(value_);
+	uint32_t value = 0;
+	for (uint32_t i = 0; i < 5; ++i) {
+		uint8_t byte;
+		if (!read(&byte)) return false;
+		value |= uint32_t(byte & 0x7f) << (7 * i);
+		if (!(byte & 0x80)) {
+			*value_ = value;
+			return true;
+		}
+	}
+	failed = true; //varint too long
+	return false;
+}
+
+uint32_t MessageReader::read_spans(size_t count, RingBuffer::Span out[2]) {
+	if (count > remaining()) {
+		failed = true;
+		at = size;
+		return 0;
+	}
+	if (count == 0) return 0;
+	//find the cursor in spans[0] or spans[1]:
+	size_t offset = at;
+	uint32_t index = 0;
+	if (offset >= spans[0].size) {
+		offset -= spans[0].size;
+		index = 1;
+	}
+	at += count;
+	size_t first = std::min(count, spans[index].size - offset);
+	out[0].data = spans[index].data + offset;
+	out[0].size = first;
+	if (first == count) return 1;
+	assert(index == 0);
+	out[1].data = spans[1].data;
+	out[1].size = count - first;
+	return 2;
+}
+
+bool MessageReader::read_string(size_t count, std::string *str) {
+	assert(str);
+	RingBuffer::Span got[2];
+	uint32_t got_count = read_spans(count, got);
+	if (count > 0 && got_count == 0) return false;
+	str->clear();
+	for (uint32_t i = 0; i < got_count; ++i) {
+		str->append(got[i].data, got[i].size);
+	}
+	return true;
+}
+
+bool MessageReader::skip(size_t count) {
+	if (count > remaining()) {
+		failed = true;
+		at = size;
+		return false;
+	}
+	at += count;
+	return true;
+}
+
+//------------------------------------
+
+MessageWriter::MessageWriter(RingBuffer &buffer_, char type, uint32_t payload_size_) : buffer(buffer_), payload_size(payload_size_) {
+	char header[MaxMessageHeaderSize];
+	size_t header_size = encode_message_header(header, type, payload_size);
+	buffer.reserve(header_size + payload_size);
+	buffer.push(header, header_size);
+}
+
+MessageWriter::MessageWriter(Connection &connection_, char type, uint32_t payload_size_) : MessageWriter(connection_.send_buffer, type, payload_size_) {
+	connection = &connection_;
+}
+
+MessageWriter::~MessageWriter() {
+	assert(written == payload_size && "message payload shorter than declared");
+	if (connection) connection->queued();
+}
+
+bool compress_message(char const *message, size_t size, std::vector< char > *out) {
+	assert(out);
+	//compress to just past the biggest possible header, then slide the block down once the header is known:
+	size_t start = out->size();
+	size_t block_at = start + MaxMessageHeaderSize + varint_size(uint32_t(size));
+	out->resize(block_at + compress_bound(size));
+	size_t block_size = compress_block(message, size, out->data() + block_at, out->size() - block_at);
+
+	char header[MaxMessageHeaderSize + 5];
+	size_t header_size = encode_message_header(header, CompressedMessage, uint32_t(varint_size(uint32_t(size)) + block_size));
+	header_size += encode_varint(header + header_size, uint32_t(size));
+	if (block_size == 0 || header_size + block_size >= size) {
+		out->resize(start);
+		return false;
+	}
+	std::memcpy(out->data() + start, header, header_size);
+	std::memmove(out->data() + start + header_size, out->data() + block_at, block_size);
+	out->resize(start + header_size + block_size);
+	return true;
+}
+
+bool decompress_message(MessageReader &reader, std::vector< char > *message, size_t max_size) {
+	assert(message);
+	uint32_t size = 0;
+	if (!reader.read_varint(&size) || size > max_size) return false;
+	size_t block_size = reader.remaining();
+	//(each byte of a block decompresses to at most 255, so don't make room for more than that)
+	if (size > block_size * 255) return false;
+	RingBuffer::Span spans[2];
+	uint32_t count = reader.read_spans(block_size, spans);
+	message->resize(size);
+	if (count == 1) {
+		return decompress_block(spans[0].data, spans[0].size, message->data(), message->size());
+	} else if (count == 2) {
+		//(block wraps around the end of the ring buffer; make it contiguous)
+		std::vector< char > block(block_size);
+		std::memcpy(block.data(), spans[0].data, spans[0].size);
+		std::memcpy(block.data() + spans[0].size, spans[1].data, spans[1].size);
+		return decompress_block(block.data(), block.size(), message->data(), message->size());
+	} else {
+		return false;
+	}
+}
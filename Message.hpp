@@ -0,0 +1,181 @@
+#pragma once
+
+/*
+ * Message framing shared by the client and server.
+ *
+ * Every message on a TCP connection is:
+ *  [type] - 1 byte
+ *  [payload size] - varint (7 bits per byte, low bits first; high bit set on all but the last byte)
+ *  [payload] - 'payload size' bytes
+ *
+ * peek_message() finds the extent of the message at the front of a
+ *  RingBuffer (e.g., a Connection's recv_buffer) by looking at its header only.
+ * MessageReader then walks the payload with a cursor, handing out values
+ *  (copied into the caller's variables) or spans pointing straight into the
+ *  buffer; nothing is removed from the buffer until the caller pops the
+ *  whole message.
+ * MessageWriter appends a message to a RingBuffer, or to a Connection's
+ *  send_buffer (letting the connection know it has data to send), reserving
+ *  room for all of it up front.
+ *
+ * Any message can also be sent compressed, wrapped in a 'z' message (see
+ *  compress_message() below); the receiver unwraps it with
+ *  decompress_message() and reads the result like any other message.
+ *
+ * For example:
+
+//reading:
+MessageHeader header;
+while (peek_message(c->recv_buffer, &header) == MessageComplete) {
+	MessageReader reader(c->recv_buffer, header);
+	if (header.type == 'x') {
+		uint32_t count = 0;
+		reader.read_varint(&count);
+		//...
+	}
+	c->recv_buffer.pop(header.total_size());
+}
+
+//writing:
+MessageWriter writer(*c, 'x', payload_size);
+writer.write_varint(count);
+//...
+
+ */
+
+#include "RingBuffer.hpp"
+
+struct Connection;
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+#include <type_traits>
+
+//longest header: type byte + five-byte varint:
+constexpr size_t MaxMessageHeaderSize = 1 + 5;
+
+//messages claiming a bigger payload than this are treated as malformed:
+constexpr uint32_t DefaultMaxMessagePayload = 1 << 24;
+
+//bytes needed to encode 'value' as a varint:
+inline size_t varint_size(uint32_t value) {
+	size_t size = 1;
+	while (value >= 0x80) {
+		value >>= 7;
+		size += 1;
+	}
+	return size;
+}
+//encode 'value' as a varint at 'dst'; returns bytes written (at most 5):
+size_t encode_varint(char *dst, uint32_t value);
+//encode a message header at 'dst' (needs MaxMessageHeaderSize bytes of room); returns bytes written:
+size_t encode_message_header(char *dst, char type, uint32_t payload_size);
+
+struct MessageHeader {
+	char type = '\0';
+	uint32_t header_size = 0; //type byte + varint
+	uint32_t payload_size = 0;
+	size_t total_size() const { return size_t(header_size) + size_t(payload_size); }
+};
+
+enum MessageStatus {
+	MessageIncomplete, //more bytes are needed to know (or have) the whole message
+	MessageComplete, //the whole message has arrived
+	MessageMalformed, //header is garbage (overlong varint or oversized payload)
+};
+
+//look at the header of the message starting 'offset' bytes into 'buffer':
+MessageStatus peek_message(RingBuffer const &buffer, size_t offset, MessageHeader *header, uint32_t max_payload = DefaultMaxMessagePayload);
+inline MessageStatus peek_message(RingBuffer const &buffer, MessageHeader *header, uint32_t max_payload = DefaultMaxMessagePayload) {
+	return peek_message(buffer, 0, header, max_payload);
+}
+
+//Cursor over a message's payload:
+// Reads past the end of the payload fail (returning false / no spans) and set 'failed'.
+struct MessageReader {
+	//read the (complete) message starting 'offset' bytes into 'buffer', whose header is 'header':
+	MessageReader(RingBuffer &buffer, MessageHeader const &header, size_t offset = 0);
+	//read a complete message stored contiguously at [data, data+size):
+	// (e.g., one handed out by ShardedServer::poll; 'failed' is set if it isn't a single well-formed message)
+	MessageReader(char const *data, size_t size);
+
+	MessageHeader header;
+
+	//bytes of payload left to read:
+	size_t remaining() const { return size - at; }
+	//did any read run past the end of the payload?
+	bool failed = false;
+
+	//copy the next 'count' bytes into 'dst':
+	bool read(void *dst, size_t count);
+	//copy the next sizeof(T) bytes into '*t' (T must be trivially copyable, e.g. uint8_t or glm::vec3):
+	template< typename T >
+	bool read(T *t) {
+		static_assert(std::is_trivially_copyable< T >::value, "read() copies raw bytes");
+		return read(reinterpret_cast< void * >(t), sizeof(T));
+	}
+	bool read_varint(uint32_t *value);
+	//point 'spans' at the next 'count' bytes (in place, without copying); returns number of spans (0 on failure):
+	uint32_t read_spans(size_t count, RingBuffer::Span spans[2]);
+	//read 'count' bytes into 'str' (reusing its storage):
+	bool read_string(size_t count, std::string *str);
+	//skip the next 'count' bytes:
+	bool skip(size_t count);
+
+	//internals:
+	RingBuffer::Span spans[2]; //payload, split where the ring wraps
+	size_t size = 0; //payload size
+	size_t at = 0; //cursor (offset into payload)
+};
+
+//Appends a message to a RingBuffer:
+// The payload size is given up front, so the header is written and space for the
+// whole message reserved just once; the destructor checks that exactly that much
+// payload was written.
+struct MessageWriter {
+	MessageWriter(RingBuffer &buffer, char type, uint32_t payload_size);
+	//append to connection.send_buffer (calling connection.queued() once the message is written):
+	MessageWriter(Connection &connection, char type, uint32_t payload_size);
+	~MessageWriter();
+	MessageWriter(MessageWriter const &) = delete;
+
+	void write(void const *data, size_t count) {
+		assert(written + count <= payload_size && "writing more payload than declared");
+		buffer.push(data, count);
+		written += count;
+	}
+	template< typename T >
+	void write(T const &t) {
+		static_assert(std::is_trivially_copyable< T >::value, "write() copies raw bytes");
+		write(&t, sizeof(T));
+	}
+	void write_varint(uint32_t value) {
+		char bytes[5];
+		write(bytes, encode_varint(bytes, value));
+	}
+
+	//internals:
+	RingBuffer &buffer;
+	uint32_t payload_size;
+	size_t written = 0;
+	Connection *connection = nullptr; //(if writing to a connection's send_buffer)
+};
+
+//Compressed messages:
+// A 'z' message wraps another (whole) message; its payload is:
+//  [size] - varint, size of the wrapped message (header and payload)
+//  [block] - the wrapped message, compressed with compress_block() (see Compress.hpp)
+constexpr char CompressedMessage = 'z';
+
+//append a 'z' message wrapping the message at [message, message+size) to '*out':
+// returns false (leaving '*out' as it was) if the 'z' message wouldn't be smaller
+bool compress_message(char const *message, size_t size, std::vector< char > *out);
+
+//read the rest of a 'z' message's payload, storing the wrapped message in '*message':
+// returns false if the payload is garbage or the wrapped message would be bigger than 'max_size'
+// (checked before allocating; clients pass MaxMessageHeaderSize + MaxServerPayload, see Protocol.hpp)
+// (then read the wrapped message with MessageReader(message->data(), message->size()))
+bool decompress_message(MessageReader &reader, std::vector< char > *message, size_t max_size = MaxMessageHeaderSize + DefaultMaxMessagePayload);
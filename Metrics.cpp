@@ -0,0 +1,138 @@
+#include "Metrics.hpp"
+
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+
+MetricsWriter::MetricsWriter(Format format_) : format(format_) {
+	if (format == JSON) out += "{";
+}
+
+void MetricsWriter::key(std::string const &name) {
+	if (format == Text) {
+		for (auto const &prefix : prefixes) {
+			out += prefix;
+			out += '.';
+		}
+		out += name;
+		out += ' ';
+	} else { assert(format == JSON);
+		if (!first) out += ',';
+		first = false;
+		//(names are plain identifiers or numbers, so need no escaping)
+		out += '"';
+		out += name;
+		out += "\":";
+	}
+}
+
+void MetricsWriter::begin(std::string const &name) {
+	if (format == Text) {
+		prefixes.emplace_back(name);
+	} else {
+		key(name);
+		out += '{';
+		first = true;
+		depth += 1;
+	}
+}
+
+void MetricsWriter::end() {
+	if (format == Text) {
+		assert(!prefixes.empty());
+		prefixes.pop_back();
+	} else {
+		assert(depth > 0);
+		out += '}';
+		first = false;
+		depth -= 1;
+	}
+}
+
+void MetricsWriter::value(std::string const &name, uint64_t value) {
+	key(name);
+	out += std::to_string(value);
+	if (format == Text) out += '\n';
+}
+
+void MetricsWriter::value(std::string const &name, double value) {
+	key(name);
+	if (std::isfinite(value)) {
+		char buffer[32];
+		std::snprintf(buffer, sizeof(buffer), "%.6g", value);
+		out += buffer;
+	} else {
+		out += (format == JSON ? "null" : "nan");
+	}
+	if (format == Text) out += '\n';
+}
+
+void MetricsWriter::histogram(std::string const &name, Histogram const &histogram) {
+	begin(name);
+	value("count", histogram.count);
+	value("mean", histogram.mean());
+	value("min", histogram.count ? histogram.min : 0);
+	value("p50", histogram.percentile(0.5));
+	value("p90", histogram.percentile(0.9));
+	value("p99", histogram.percentile(0.99));
+	value("p999", histogram.percentile(0.999));
+	value("max", histogram.max);
+	end();
+}
+
+std::string const &MetricsWriter::finish() {
+	assert(prefixes.empty() && depth == 0 && "groups left open");
+	if (format == JSON) {
+		out += "}";
+		depth = ~0u; //(so finish() can't be called twice)
+	}
+	return out;
+}
+
+//------------------------------------
+
+MetricsEndpoint::MetricsEndpoint(std::string const &port) : server(port, false, "localhost") {
+}
+
+void MetricsEndpoint::poll(std::function< std::string() > const &report) {
+	//requests are tiny; anything bigger than this is someone else's protocol:
+	constexpr size_t MaxRequest = 8192;
+
+	std::string response; //(made at most once per poll)
+
+	server.poll([&](Connection *c, Connection::Event evt){
+		if (evt == Connection::OnClose) {
+			answered.erase(c);
+		}
+		if (evt != Connection::OnRecv || answered.count(c)) return;
+
+		//wait for the end of the first line of the request (e.g., "GET / HTTP/1.1"):
+		std::string request = c->recv_buffer.peek_string(0, std::min(c->recv_buffer.size(), MaxRequest));
+		if (request.find('\n') == std::string::npos) {
+			if (request.size() == MaxRequest) {
+				c->close();
+				answered.erase(c);
+			}
+			return;
+		}
+		c->recv_buffer.clear();
+
+		if (response.empty()) response = report();
+		if (request.compare(0, 4, "GET ") == 0) {
+			//looks like http, so answer like a (very simple) web server:
+			std::string header = "HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\nContent-Length: " + std::to_string(response.size()) + "\r\nConnection: close\r\n\r\n";
+			c->send_raw(header.data(), header.size());
+		}
+		c->send_raw(response.data(), response.size());
+		answered.emplace(c);
+	}, 0.0);
+
+	//hang up once responses have gone out:
+	for (auto &c : server.connections) {
+		if (c.socket != InvalidSocket && !c.send_pending() && answered.erase(&c)) {
+			c.close();
+		}
+	}
+}
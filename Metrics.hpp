@@ -0,0 +1,77 @@
+#pragma once
+
+/*
+ * Helpers for reporting a server's counters and histograms.
+ *
+ * MetricsWriter formats a tree of named values either as plain text (one
+ *  "dotted.name value" line per value, easy to grep) or as a single-line JSON
+ *  object (easy to append to a log and load into a script), so the same code
+ *  can produce both.
+ *
+ * MetricsEndpoint listens on a (local-only) port and answers every request
+ *  with a report -- e.g., `curl localhost:1338` or `echo | nc localhost 1338`.
+ *
+ * For example:
+
+MetricsEndpoint endpoint("1338");
+while (true) {
+	endpoint.poll([&](){
+		MetricsWriter out(MetricsWriter::Text);
+		out.begin("tick");
+		out.value("count", tick_count);
+		out.histogram("duration_us", tick_us);
+		out.end();
+		return out.finish();
+	});
+}
+
+ */
+
+#include "Connection.hpp"
+#include "Histogram.hpp"
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <unordered_set>
+
+struct MetricsWriter {
+	enum Format {
+		Text,
+		JSON
+	};
+	MetricsWriter(Format format);
+
+	//start / end a group of values (groups nest):
+	void begin(std::string const &name);
+	void end();
+
+	void value(std::string const &name, uint64_t value);
+	void value(std::string const &name, double value);
+	//count, mean, min, max, and a few percentiles:
+	void histogram(std::string const &name, Histogram const &histogram);
+
+	//get the report (all groups must have been ended):
+	std::string const &finish();
+
+	//internals:
+	Format format;
+	std::string out;
+	std::vector< std::string > prefixes; //(Text) dotted names of the open groups
+	bool first = true; //(JSON) no value written yet in the innermost group
+	uint32_t depth = 0; //(JSON) open groups
+	void key(std::string const &name); //start a value called 'name'
+};
+
+struct MetricsEndpoint {
+	//listen for requests on 'port', on localhost only:
+	MetricsEndpoint(std::string const &port);
+
+	//answer any requests that have arrived with the result of 'report' (never waits):
+	// (called at most once per poll, and only if someone is asking)
+	void poll(std::function< std::string() > const &report);
+
+	//internals:
+	Server server;
+	std::unordered_set< Connection const * > answered; //connections to close once their response is sent
+};
@@ -3,13 +3,17 @@
 #include "DrawLines.hpp"
 #include "gl_errors.hpp"
 #include "data_path.hpp"
-#include "hex_dump.hpp"
+#include "Log.hpp"
+#include "Message.hpp"
+#include "Protocol.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/string_cast.hpp>
 #include <glm/gtx/quaternion.hpp>
 
 #include <random>
+#include <cstring>
+#include <algorithm>
 
 GLuint pie_meshes_for_lit_color_texture_program = 0;
 Load< MeshBuffer > pie_meshes(LoadTagDefault, []() -> MeshBuffer const * {
@@ -40,7 +44,81 @@ Load< WalkMeshes > phonebank_walkmeshes(LoadTagDefault, []() -> WalkMeshes const
 	return ret;
 });
 
-PlayMode::PlayMode(Client &client_) : scene(*phonebank), client(client_) { 
+//decode messages (framed as in Message.hpp, of the types in Protocol.hpp) from the server:
+// (runs on the network thread, if there is one)
+static void decode_server_messages(RingBuffer &buffer, SnapshotReceiver &snapshots, std::function< void(PlayMode::ServerEvent &&) > const &emit) {
+	LOG_HEX(Log::Debug, "recv'd data. Current buffer:", buffer.linearize(), buffer.size());
+	MessageHeader header;
+	std::vector< char > inflated; //(decompressed 'z' messages)
+	while (true) {
+		MessageStatus status = peek_message(buffer, &header, MaxServerPayload);
+		if (status == MessageIncomplete) break; //if whole message isn't here, can't process
+		if (status == MessageMalformed) {
+			throw std::runtime_error("Server sent a malformed message.");
+		}
+		MessageReader message(buffer, header);
+		if (header.type == CompressedMessage) {
+			if (!decompress_message(message, &inflated, MaxMessageHeaderSize + MaxServerPayload)) {
+				throw std::runtime_error("Server sent a garbled compressed message.");
+			}
+			message = MessageReader(inflated.data(), inflated.size());
+			if (message.failed || message.header.type == CompressedMessage) {
+				throw std::runtime_error("Server sent a compressed message that isn't a single message.");
+			}
+		}
+
+		PlayMode::ServerEvent event;
+		event.type = message.header.type;
+		if (event.type == ServerPositionFormat) {
+			uint8_t bits = 0;
+			glm::vec3 min, max;
+			message.read(&bits);
+			message.read(&min);
+			message.read(&max);
+			if (message.failed) throw std::runtime_error("Server sent a truncated position format.");
+			event.position_format = PositionFormat(bits, min, max); //(throws if it's nonsense)
+			snapshots.format = event.position_format;
+		} else if (event.type == ServerDatagramToken) {
+			message.read(&event.datagram_token);
+		} else if (event.type == ServerDatagramAck) {
+			message.read(&event.datagram_ack);
+		} else if (event.type == ServerTickRate) {
+			message.read(&event.tick_rate);
+			if (!(event.tick_rate > 0.0f)) throw std::runtime_error("Server sent a bad tick rate.");
+		} else if (event.type == ServerPong) {
+			message.read(&event.ping_sent);
+			message.read(&event.ping_received);
+			message.read(&event.pong_sent);
+			event.received = JitterBuffer::Clock::now();
+		} else if (event.type == ServerStatus) {
+			message.read_string(message.remaining(), &event.status);
+		} else if (event.type == ServerPlayerJoined) {
+			message.read(&event.player_id);
+			message.read_string(message.remaining(), &event.player_name);
+		} else if (event.type == ServerPlayerLeft) {
+			message.read(&event.player_id);
+		} else if (event.type == ServerSnapshot) {
+			Snapshot const &snapshot = snapshots.receive(message);
+			event.snapshot_sequence = snapshot.sequence;
+			event.other_players = snapshot.players;
+			event.received = JitterBuffer::Clock::now();
+		} else {
+			throw std::runtime_error("Server sent unknown message type '" + std::to_string(event.type) + "'");
+		}
+		if (message.failed || message.remaining() != 0) { // PARANOIA: the payload should be exactly what its type says
+			throw std::runtime_error("Server sent a '" + std::string(1, event.type) + "' message of the wrong size.");
+		}
+
+		buffer.pop(header.total_size());
+		emit(std::move(event));
+	}
+}
+
+PlayMode::PlayMode(Client &client_, bool network_thread, double send_rate_) : scene(*phonebank), client(client_), datagrams(client_.connection),
+	network(client_, network_thread, [this](RingBuffer &buffer, std::function< void(ServerEvent &&) > const &emit){
+		decode_server_messages(buffer, snapshots, emit);
+	}), send_rate(send_rate_) { 
+	if (send_rate > 0.0) send_period = 1.0 / send_rate;
 
 	{ // initialize the scene
 		scene.transforms.emplace_back(); // add player transform
@@ -83,6 +161,11 @@ PlayMode::PlayMode(Client &client_) : scene(*phonebank), client(client_) {
 	// ----- init game state ------
 	player_pos = glm::vec3(0, 0, 0);
 
+	//tell the server what this client can handle (goes out with the first poll):
+	{
+		MessageWriter message(network.outgoing, ClientCapabilities, 1);
+		message.write(CapabilityCompression);
+	}
 }
 
 PlayMode::~PlayMode() {
@@ -250,23 +333,71 @@ void PlayMode::update(float elapsed) {
 		}
   	}
 
-	// queue data for sending to server:
-	// send a message of that starts with 'b', and contains button press data and
-	// player location data
-	client.connections.back().send('b');
-	client.connections.back().send((uint8_t)num_pies_collected);
-	client.connections.back().send((uint8_t)has_won);
-
 	player_pos = player.transform->position;
-	// send player data to the server
-	std::vector<char>player_pos_data;
-	char* _player_pos_data = reinterpret_cast<char*>(&player_pos);
-	size_t n = sizeof(player_pos) / sizeof(char);
-	for (size_t i = 0; i < n; i++)
-	{
-		client.connections.back().send(_player_pos_data[i]);
+
+	// queue data for sending to server, once per send slot (see PlayMode.hpp):
+	// (positions are encoded as the server said in its 'f' message, so nothing is sent before that)
+	until_send -= elapsed;
+	since_sent += elapsed;
+	since_datagram_ack += elapsed;
+	if (datagrams_acked && since_datagram_ack > DatagramAckTimeout) {
+		//datagrams stopped getting through (or their acks did); send positions over TCP again until they are acked:
+		LOG_WARN("Position datagrams are no longer being acked; sending positions in 'b' messages.");
+		datagrams_acked = false;
 	}
-	
+	if (has_position_format && until_send <= 0.0) {
+		until_send += send_period;
+		if (until_send <= 0.0) until_send = send_period; //(a long frame skipped some slots; don't try to catch up)
+
+		char position[PositionFormat::MaxSize];
+		position_format.encode(player_pos, position);
+		size_t position_size = position_format.size();
+		bool moved = !has_sent || std::memcmp(position, sent_position, position_size) != 0;
+		if (moved) repeats_left = StopRepeats;
+		bool state_changed = !has_sent || num_pies_collected != sent_num_pies_collected || has_won != sent_has_won;
+		bool keepalive = since_sent >= KeepaliveInterval;
+
+		bool by_datagram = (datagram_token != 0 && datagrams_acked);
+		bool sent = false;
+		if (state_changed || (!by_datagram && (moved || keepalive))) {
+			// 'b' message with pie count, win flag, and position (built here so it goes into the buffer in one copy):
+			char message[MaxMessageHeaderSize + 2 + PositionFormat::MaxSize];
+			size_t size = encode_message_header(message, ClientState, client_state_payload(position_format));
+			message[size++] = char(uint8_t(num_pies_collected));
+			message[size++] = char(uint8_t(has_won));
+			std::memcpy(message + size, position, position_size);
+			size += position_size;
+			network.outgoing.push(message, size);
+			sent = true;
+		}
+		if (datagram_token != 0 && !(sent && by_datagram) && (moved || repeats_left > 0 || keepalive)) {
+			// position datagram; if it is lost, the next one supersedes it anyway:
+			// [p] - 1 byte
+			// [token] - 4 bytes
+			// [sequence number] - 4 bytes
+			// [position] - position_format.size() bytes
+			if (!moved && repeats_left > 0) repeats_left -= 1;
+			datagram_sequence += 1;
+			char message[1 + 4 + 4 + PositionFormat::MaxSize];
+			message[0] = 'p';
+			for (uint32_t i = 0; i < 4; ++i) {
+				message[1 + i] = char(uint8_t(datagram_token >> (24 - 8 * i)));
+				message[5 + i] = char(uint8_t(datagram_sequence >> (24 - 8 * i)));
+			}
+			std::memcpy(message + 9, position, position_size);
+			datagrams.send(message, 9 + position_size);
+			sent = true;
+		}
+
+		if (sent) {
+			has_sent = true;
+			since_sent = 0.0;
+			sent_num_pies_collected = num_pies_collected;
+			sent_has_won = has_won;
+			std::memcpy(sent_position, position, position_size);
+		}
+	}
+
 	//reset button press counters:
 	left.downs = 0;
 	right.downs = 0;
@@ -274,74 +405,97 @@ void PlayMode::update(float elapsed) {
 	down.downs = 0;
 
 	//send/receive data:
-	client.poll([this](Connection *c, Connection::Event event){
-		if (event == Connection::OnOpen) {
-			std::cout << "[" << c->socket << "] opened" << std::endl;
-		} else if (event == Connection::OnClose) {
-			std::cout << "[" << c->socket << "] closed (!)" << std::endl;
-			throw std::runtime_error("Lost connection to server!");
-		} else { assert(event == Connection::OnRecv);
-			std::cout << "[" << c->socket << "] recv'd data. Current buffer:\n" << hex_dump(c->recv_buffer); std::cout.flush();
-			//expecting message(s) like 'm' + 3-byte length + length bytes of text:
-			while (c->recv_buffer.size() >= 4) {
-				// step 1) interpret server message 
-				std::cout << "[" << c->socket << "] recv'd data. Current buffer:\n" << hex_dump(c->recv_buffer); std::cout.flush();
-				char type = c->recv_buffer[0];
-				if (type != 'm') {
-					throw std::runtime_error("Server sent unknown message type '" + std::to_string(type) + "'");
+	network.poll();
+
+	{ //act on messages from the server:
+		ServerEvent event;
+		while (network.try_pop(&event)) {
+			if (event.type == ServerPositionFormat) {
+				position_format = event.position_format;
+				has_position_format = true;
+			} else if (event.type == ServerDatagramToken) {
+				datagram_token = event.datagram_token;
+			} else if (event.type == ServerDatagramAck) {
+				datagrams_acked = true;
+				since_datagram_ack = 0.0;
+			} else if (event.type == ServerTickRate) {
+				jitter.tick_period = 1.0 / double(event.tick_rate);
+				if (send_rate <= 0.0) send_period = jitter.tick_period;
+			} else if (event.type == ServerPong) {
+				if (!clock_sync.pong(event.ping_sent, event.ping_received, event.pong_sent, monotonic_ns(event.received))) {
+					LOG_WARN("Server sent a pong with inconsistent times; ignoring it.");
 				}
-				uint32_t server_message_size = (
-					(uint32_t(c->recv_buffer[1]) << 16) | (uint32_t(c->recv_buffer[2]) << 8) | (uint32_t(c->recv_buffer[3]))
-				);
-				if (c->recv_buffer.size() < 4 + server_message_size) break; //if whole message isn't here, can't process
-				//whole message *is* here, so set current server message:
-				server_message = std::string(c->recv_buffer.begin() + 4, c->recv_buffer.begin() + 4 + server_message_size);
-
-				//and consume this part of the buffer:
-				c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 4 + server_message_size);
-				
-				// step 2) interpret data about other players
-				uint32_t other_players_data_size = (
-					(uint32_t(c->recv_buffer[0]) << 16) | (uint32_t(c->recv_buffer[1]) << 8) | (uint32_t(c->recv_buffer[2]))
-				);
-				uint8_t other_players_size = c->recv_buffer[3];
-				c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + 4);
-				size_t byte_count = 0; // counts the total number of bytes read in other_players_data
-
-				for (size_t i = 0; i < other_players_size; i++) {
-					glm::vec3* oplayer_position = reinterpret_cast<glm::vec3*>(&c->recv_buffer[0]);
-					byte_count += sizeof(glm::vec3);
-					uint8_t oplayer_namesize = c->recv_buffer[0 + sizeof(glm::vec3)];
-					std::string oplayer_name = std::string(c->recv_buffer.begin() + sizeof(glm::vec3), c->recv_buffer.begin() + sizeof(glm::vec3) + oplayer_namesize);
-					byte_count += oplayer_name.size();
-					assert(oplayer_name.size() == oplayer_namesize);
-
-					// if the other player is not in the other_players_data map, add them, and 
-					// then set their data
-					auto opd = other_players_data.find(oplayer_name);
-					if (opd == other_players_data.end()) {
-						scene.transforms.emplace_back();
-						Scene::Transform *other_player_transform = &scene.transforms.back();
-						other_player_transform->position = *oplayer_position;
-						scene.drawables.emplace_back(Scene::Drawable(other_player_transform));
-						Scene::Drawable *other_player = &scene.drawables.back();
-						other_player->pipeline = other_player_base;
-						OtherPlayersData oplayer_data = OtherPlayersData(*oplayer_position);
-						oplayer_data.drawable = other_player;
-						other_players_data.insert(std::pair<std::string, OtherPlayersData>(oplayer_name, oplayer_data));					
-					} else {
-						opd->second.position = *oplayer_position;
-						std::cout << opd->first << ": " << to_string(opd->second.position) << std::endl;
-						assert(opd->second.drawable);
-						opd->second.drawable->transform->position = *oplayer_position;
-					}
-					c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + sizeof(glm::vec3) + oplayer_name.size());
+			} else if (event.type == ServerStatus) {
+				server_message = std::move(event.status);
+			} else if (event.type == ServerPlayerJoined) {
+				if (event.player_id >= other_players_data.size()) other_players_data.resize(event.player_id + 1);
+				OtherPlayersData &opd = other_players_data[event.player_id];
+				opd.joined = true;
+				opd.name = std::move(event.player_name);
+				opd.snapshot_sequence = 0;
+				opd.track.clear();
+				if (!opd.drawable) {
+					scene.transforms.emplace_back();
+					scene.drawables.emplace_back(Scene::Drawable(&scene.transforms.back()));
+					opd.drawable = &scene.drawables.back();
+					opd.drawable->pipeline = other_player_base;
+				}
+				opd.drawable->transform->scale = glm::vec3(0.0f); //(hidden until it shows up in a snapshot)
+			} else if (event.type == ServerPlayerLeft) {
+				if (event.player_id < other_players_data.size()) {
+					OtherPlayersData &opd = other_players_data[event.player_id];
+					opd.joined = false;
+					if (opd.drawable) opd.drawable->transform->scale = glm::vec3(0.0f);
+				}
+			} else { assert(event.type == ServerSnapshot);
+				//every snapshot (not just the newest) goes on the tracks, so the motion between them can be shown:
+				double time = jitter.received(event.snapshot_sequence, event.received);
+				for (auto const &oplayer : event.other_players) {
+					//(ids the client doesn't know -- e.g., of a player who left after the snapshot was made -- are skipped)
+					if (oplayer.id >= other_players_data.size() || !other_players_data[oplayer.id].joined) continue;
+					OtherPlayersData &opd = other_players_data[oplayer.id];
+					//(a player coming back into view shouldn't slide over from where they were last seen)
+					if (opd.snapshot_sequence != last_snapshot) opd.track.clear();
+					opd.track.add(time, oplayer.position);
+					opd.position = oplayer.position;
+					opd.snapshot_sequence = event.snapshot_sequence;
+					LOG_TRACE(opd.name << ": " << to_string(opd.position));
 				}
-				assert(byte_count == other_players_data_size); // PARANOIA: the number of bytes read should equal the number of bytes
-				// that was specified in the message
+				last_snapshot = event.snapshot_sequence;
 			}
 		}
-	}, 0.0);
+		//measure the round trip now and then:
+		// (goes out with the next poll)
+		ClockSync::Ping ping;
+		if (clock_sync.ping(monotonic_ns(), &ping)) {
+			MessageWriter message(network.outgoing, ClientPing, ClientPingPayload);
+			message.write(ping.sent);
+			message.write(ping.echo);
+			message.write(ping.held);
+		}
+		//let the server know which snapshot to send the next delta against:
+		// (goes out with the next poll)
+		if (last_snapshot != 0 && last_snapshot != acked_snapshot) {
+			acked_snapshot = last_snapshot;
+			MessageWriter message(network.outgoing, ClientSnapshotAck, uint32_t(varint_size(acked_snapshot)));
+			message.write_varint(acked_snapshot);
+		}
+		//the server only sends nearby players, so show just the ones in the newest snapshot,
+		// where they were a moment ago (see JitterBuffer.hpp):
+		if (last_snapshot != 0) {
+			double show = jitter.render_time(JitterBuffer::Clock::now());
+			for (auto &opd : other_players_data) {
+				if (!opd.joined) continue;
+				assert(opd.drawable);
+				if (opd.snapshot_sequence != last_snapshot) {
+					opd.drawable->transform->scale = glm::vec3(0.0f);
+				} else {
+					opd.drawable->transform->position = opd.track.sample(show, MaxExtrapolation);
+					opd.drawable->transform->scale = glm::vec3(1.0f);
+				}
+			}
+		}
+	}
 
 	{ // if the player collides with a  pie, remove it from the list of drawables and add score
 		for (auto p : pies) {
@@ -412,6 +566,10 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 
 		draw_text(glm::vec2(-aspect + 0.1f, 0.0f), server_message, 0.09f);
 
+		if (clock_sync.round_trips.count() != 0) {
+			draw_text(glm::vec2(-aspect + 0.1f, 0.9f), "ping " + std::to_string(int(clock_sync.round_trips.rtt * 1000.0 + 0.5)) + " ms", 0.06f);
+		}
+
 		draw_text(glm::vec2(-aspect + 0.1f,-0.9f), "Use WASD to move around, walk toward a pie to collect it. Whoever collects the most pies wins!", 0.09f);
 		
 	}
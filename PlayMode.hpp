@@ -1,6 +1,11 @@
 #include "Mode.hpp"
 
 #include "Connection.hpp"
+#include "ClientThread.hpp"
+#include "DatagramSocket.hpp"
+#include "Snapshot.hpp"
+#include "JitterBuffer.hpp"
+#include "ClockSync.hpp"
 #include "ColorTextureProgram.hpp"
 #include "LitColorTextureProgram.hpp"
 #include "Mesh.hpp"
@@ -22,7 +27,9 @@
 #include <unordered_set>
 
 struct PlayMode : Mode {
-	PlayMode(Client &client);
+	//network_thread: do socket I/O and message decoding on a separate thread (see ClientThread.hpp)
+	//send_rate: how many times per second to send updates to the server (0 => once per server tick)
+	PlayMode(Client &client, bool network_thread = false, double send_rate = 0.0);
 	virtual ~PlayMode();
 
 	//functions called by main loop:
@@ -32,15 +39,21 @@ struct PlayMode : Mode {
 
 	//----- game state -----
 	struct OtherPlayersData {
-		OtherPlayersData(glm::vec3 p) : position(p) {};
-
 		// ----- data received by the server -----
-		glm::vec3 position; // this position could be different from this->drawable->transform->position
+		bool joined = false; //between the server's 'j' and 'l' messages for this id
+		std::string name;
+		glm::vec3 position = glm::vec3(0.0f); // this position could be different from this->drawable->transform->position
+		PositionTrack track; //recent positions, on the server's timeline (drawn a little in the past; see JitterBuffer.hpp)
 
 		// ----- data created by the client -----
-		Scene::Drawable* drawable;
+		Scene::Drawable *drawable = nullptr; //(kept when the player leaves, for the next player with this id)
+		uint32_t snapshot_sequence = 0; //newest snapshot the player was in
 	};
-	std::map<std::string, OtherPlayersData> other_players_data;
+	std::vector< OtherPlayersData > other_players_data; //indexed by player id (see Protocol.hpp)
+	//when (on the server's timeline) to show other players at:
+	JitterBuffer jitter;
+	static constexpr double MaxExtrapolation = 0.1; //seconds to keep moving a player past their newest position (if snapshots are late)
+	uint32_t last_snapshot = 0; //newest snapshot applied to the tracks
 
 	std::vector<Scene::Drawable> pies;
 	//input tracking:
@@ -75,6 +88,59 @@ struct PlayMode : Mode {
 
 	//connection to server:
 	Client &client;
+
+	//a message from the server, decoded (on the network thread, if there is one):
+	struct ServerEvent {
+		char type = '\0'; //message type (see Protocol.hpp)
+		PositionFormat position_format; //(ServerPositionFormat)
+		uint32_t datagram_token = 0; //(ServerDatagramToken)
+		uint32_t datagram_ack = 0; //(ServerDatagramAck)
+		float tick_rate = 0.0f; //(ServerTickRate)
+		std::string status; //(ServerStatus)
+		uint16_t player_id = 0; //(ServerPlayerJoined, ServerPlayerLeft)
+		std::string player_name; //(ServerPlayerJoined)
+		uint32_t snapshot_sequence = 0; //(ServerSnapshot)
+		std::vector< Snapshot::Player > other_players; //(ServerSnapshot) every other player, not just the changed ones
+		uint64_t ping_sent = 0, ping_received = 0, pong_sent = 0; //(ServerPong) see ClockSync.hpp
+		JitterBuffer::Clock::time_point received; //(ServerSnapshot, ServerPong) when it arrived
+	};
+	SnapshotReceiver snapshots; //recent snapshots, to decode deltas against (used only by the decoder)
+	//unreliable side channel for position updates:
+	// (made from client.connection, so it's declared -- and constructed -- before 'network' starts polling 'client')
+	DatagramSocket datagrams;
+	ClientThread< ServerEvent > network; //polls 'client'; don't use 'client' directly
+	uint32_t acked_snapshot = 0; //newest snapshot acked to the server
+
+	//round trip time to the server, and its clock (from 'q' / 'o' messages):
+	ClockSync clock_sync;
+
+	//how positions are encoded (sent by the server in an 'f' message; nothing is sent until it arrives):
+	PositionFormat position_format;
+	bool has_position_format = false;
+
+	//position datagrams (see 'datagrams', above):
+	uint32_t datagram_token = 0; //sent by the server in a 'u' message (0 => not yet known; send positions over TCP)
+	uint32_t datagram_sequence = 0; //sequence number of the last position datagram sent
+	bool datagrams_acked = false; //the server has acked datagrams ('d') lately, so positions needn't go in 'b' too
+	double since_datagram_ack = 0.0; //seconds since the last 'd' (see DatagramAckTimeout in Protocol.hpp)
+
+	//updates to the server go out in send slots, send_rate per second (0 => at the server's tick rate, from
+	// its 't' message); a slot is skipped if nothing changed since the last update, unless KeepaliveInterval
+	// has passed. ('b' carries everything, and is sent when the pie count or win flag changes -- these must
+	// arrive -- or, until the server acks datagrams, when the position changes. A datagram is sent whenever
+	// the position changes, too, unless a 'b' already went with datagrams acked -- so there is something to ack.)
+	double send_rate = 0.0;
+	double send_period = 1.0 / 30.0; //seconds between send slots
+	static constexpr double KeepaliveInterval = 1.0; //seconds
+	static constexpr uint32_t StopRepeats = 2; //extra datagrams sent once the position stops changing (in case the last one was lost)
+	double until_send = 0.0; //seconds until the next send slot
+	double since_sent = 0.0; //seconds since the last update
+	bool has_sent = false;
+	//what the last update said:
+	size_t sent_num_pies_collected = 0;
+	bool sent_has_won = false;
+	char sent_position[PositionFormat::MaxSize]; //(encoded)
+	uint32_t repeats_left = 0; //(of StopRepeats)
 	// ----------
 
 
@@ -0,0 +1,75 @@
+#include "PositionFormat.hpp"
+
+#include "WalkMesh.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cassert>
+#include <cstring>
+#include <cmath>
+#include <string>
+
+PositionFormat::PositionFormat(uint8_t bits_, glm::vec3 const &min_, glm::vec3 const &max_) : bits(bits_), min(min_), max(max_) {
+	if (bits > MaxBits) {
+		throw std::runtime_error("Can't quantize positions to " + std::to_string(bits) + " bits per axis (at most " + std::to_string(MaxBits) + ").");
+	}
+	if (bits != 0 && !(min.x < max.x && min.y < max.y && min.z < max.z)) {
+		throw std::runtime_error("Can't quantize positions to an empty (or inside-out) box.");
+	}
+}
+
+PositionFormat PositionFormat::for_walkmesh(WalkMesh const &walkmesh, uint8_t bits) {
+	if (walkmesh.vertices.empty()) {
+		throw std::runtime_error("Can't quantize positions to an empty walkmesh.");
+	}
+	glm::vec3 min = walkmesh.vertices[0];
+	glm::vec3 max = walkmesh.vertices[0];
+	for (auto const &v : walkmesh.vertices) {
+		min = glm::min(min, v);
+		max = glm::max(max, v);
+	}
+	//pad a bit, so points computed from barycentric weights (and flat axes) are still inside:
+	constexpr float Padding = 0.01f;
+	return PositionFormat(bits, min - glm::vec3(Padding), max + glm::vec3(Padding));
+}
+
+glm::vec3 PositionFormat::precision() const {
+	if (bits == 0) return glm::vec3(0.0f);
+	return 0.5f * (max - min) / float((1u << bits) - 1u);
+}
+
+void PositionFormat::encode(glm::vec3 const &position, char *dst) const {
+	if (bits == 0) {
+		std::memcpy(dst, &position, sizeof(glm::vec3));
+		return;
+	}
+	uint32_t const top = (1u << bits) - 1u;
+	uint64_t packed = 0;
+	for (uint32_t axis = 0; axis < 3; ++axis) {
+		float t = (position[axis] - min[axis]) / (max[axis] - min[axis]);
+		//(NaN goes to 0)
+		uint32_t q = (t > 0.0f ? uint32_t(std::min(std::round(t * float(top)), float(top))) : 0u);
+		packed |= uint64_t(q) << (axis * bits);
+	}
+	for (size_t i = 0; i < size(); ++i) {
+		dst[i] = char(uint8_t(packed >> (8 * i)));
+	}
+}
+
+glm::vec3 PositionFormat::decode(char const *src) const {
+	glm::vec3 position;
+	if (bits == 0) {
+		std::memcpy(&position, src, sizeof(glm::vec3));
+		return position;
+	}
+	uint64_t packed = 0;
+	for (size_t i = 0; i < size(); ++i) {
+		packed |= uint64_t(uint8_t(src[i])) << (8 * i);
+	}
+	uint32_t const top = (1u << bits) - 1u;
+	for (uint32_t axis = 0; axis < 3; ++axis) {
+		uint32_t q = uint32_t(packed >> (axis * bits)) & top;
+		position[axis] = min[axis] + (max[axis] - min[axis]) * (float(q) / float(top));
+	}
+	return position;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+/*
+ * PositionFormat says how positions are encoded on the wire.
+ *
+ * Every player stands on the level's WalkMesh, so positions can be sent as
+ *  fixed-point values within the walkmesh's bounding box: 'bits' bits per
+ *  axis, packed together (so, e.g., 16 bits per axis takes 6 bytes instead
+ *  of the 12 of a raw glm::vec3). bits == 0 means raw glm::vec3s.
+ *
+ * The server picks the format and announces it with the first message on
+ *  every connection ('f'; see Protocol.hpp); clients don't send positions
+ *  until they have it.
+ */
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstddef>
+
+struct WalkMesh;
+
+struct PositionFormat {
+	//raw glm::vec3 positions:
+	PositionFormat() = default;
+	//positions quantized to 'bits' (1 to MaxBits) bits per axis within the box [min, max]:
+	PositionFormat(uint8_t bits, glm::vec3 const &min, glm::vec3 const &max);
+	//quantized within (a slightly padded version of) the bounding box of a walkmesh:
+	static PositionFormat for_walkmesh(WalkMesh const &walkmesh, uint8_t bits);
+
+	uint8_t bits = 0; //per axis; 0 => raw glm::vec3
+	glm::vec3 min = glm::vec3(0.0f);
+	glm::vec3 max = glm::vec3(0.0f);
+
+	static constexpr uint8_t MaxBits = 21; //(so the packed axes fit in 64 bits)
+	static constexpr size_t MaxSize = sizeof(glm::vec3); //largest size() of any format
+
+	//bytes per encoded position:
+	size_t size() const {
+		return (bits == 0 ? sizeof(glm::vec3) : (3 * size_t(bits) + 7) / 8);
+	}
+	//about the largest difference (per axis) between a position in the box and its decoded encoding:
+	glm::vec3 precision() const;
+
+	//write size() bytes to 'dst' (positions outside the box are clamped to it):
+	void encode(glm::vec3 const &position, char *dst) const;
+	//read size() bytes from 'src':
+	glm::vec3 decode(char const *src) const;
+	//the position the other end will see after encode() + decode():
+	glm::vec3 round_trip(glm::vec3 const &position) const {
+		char data[MaxSize];
+		encode(position, data);
+		return decode(data);
+	}
+};
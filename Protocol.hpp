@@ -0,0 +1,116 @@
+#pragma once
+
+/*
+ * Messages exchanged by client and server (framed as described in Message.hpp).
+ *
+ * Clients that send CapabilityCompression (in a 'c' message) may get any
+ *  server message other than 'f' and 'u' wrapped in a compressed 'z' message
+ *  (see Message.hpp).
+ *
+ */
+
+#include "PositionFormat.hpp"
+
+#include <glm/glm.hpp>
+
+//client -> server:
+
+// 'b' - pie count / win flag / position (not sent until the server's 'f' message has arrived; once the
+//  server acks position datagrams with 'd', positions go in those instead, and 'b' only when the rest changes):
+//  [pies collected] - uint8_t
+//  [has won] - uint8_t
+//  [position] - PositionFormat::size() bytes
+constexpr char ClientState = 'b';
+inline uint32_t client_state_payload(PositionFormat const &format) {
+	return 2 + uint32_t(format.size());
+}
+
+// 'a' - newest snapshot received (so the server can send deltas against it; see Snapshot.hpp):
+//  [sequence] - varint
+constexpr char ClientSnapshotAck = 'a';
+
+// 'c' - what the client can handle (sent once, right after connecting; without it, the server assumes nothing):
+//  [flags] - uint8_t, CapabilityCompression
+constexpr char ClientCapabilities = 'c';
+constexpr uint8_t CapabilityCompression = 0x1; //understands 'z' messages
+
+// 'q' - ping (sent every ClockSync::PingInterval or so; the server answers each with an 'o'; see ClockSync.hpp):
+//  [sent] - uint64_t, client's monotonic clock (nanoseconds) when this was sent
+//  [echo] - uint64_t, [sent] from the newest 'o' the client got (0 => none yet)
+//  [held] - uint64_t, nanoseconds between that 'o' arriving and this being sent
+constexpr char ClientPing = 'q';
+constexpr uint32_t ClientPingPayload = 3 * sizeof(uint64_t);
+
+//largest message the server will accept from a client:
+constexpr uint32_t MaxClientPayload = 64;
+
+//server -> client:
+
+// 'f' - how positions are encoded (always the first message; see PositionFormat.hpp):
+//  [bits] - uint8_t, per axis (0 => raw glm::vec3)
+//  [min] - glm::vec3
+//  [max] - glm::vec3
+constexpr char ServerPositionFormat = 'f';
+constexpr uint32_t ServerPositionFormatPayload = 1 + 2 * sizeof(glm::vec3);
+
+// 'u' - how to tag position datagrams (see server.cpp):
+//  [token] - uint32_t
+constexpr char ServerDatagramToken = 'u';
+
+// 'd' - position datagrams are getting through (sent for the first datagram the server accepts from a
+//  client, then at most every DatagramAckInterval while more arrive):
+//  [sequence] - uint32_t, sequence number of the newest datagram accepted
+constexpr char ServerDatagramAck = 'd';
+constexpr uint32_t ServerDatagramAckPayload = sizeof(uint32_t);
+constexpr double DatagramAckInterval = 0.5; //seconds
+//clients keep sending positions in 'b' messages until a 'd' arrives, and go back to that if none arrives for
+// DatagramAckTimeout (clients send something at least once a second, so acks keep coming while datagrams do):
+constexpr double DatagramAckTimeout = 3.0; //seconds
+
+// 't' - how often the server ticks (one snapshot sequence number per tick; clients use it to place
+//  snapshots in time, see JitterBuffer.hpp):
+//  [ticks per second] - float
+constexpr char ServerTickRate = 't';
+
+// 'o' - pong, the answer to a 'q' (see ClockSync.hpp):
+//  [ping sent] - uint64_t, [sent] from the 'q'
+//  [ping received] - uint64_t, server's monotonic clock (nanoseconds) when the 'q' arrived
+//  [sent] - uint64_t, server's monotonic clock when this was sent
+constexpr char ServerPong = 'o';
+constexpr uint32_t ServerPongPayload = 3 * sizeof(uint64_t);
+
+// 'm' - status message:
+//  [text] - the whole payload
+constexpr char ServerStatus = 'm';
+
+// Players are named by ids (1 to MaxPlayerId) that last as long as the player's connection; each
+//  client hears about every player's arrival ('j') and departure ('l') once, and snapshots only
+//  carry ids. (An id isn't reused until many others have been, so a snapshot that was held back
+//  may still mention a player that has left; clients ignore ids they don't know.)
+constexpr uint32_t MaxPlayerId = 0xffff;
+
+// 'j' - a player joined (a new client gets one for every other player, then one whenever someone else joins):
+//  [id] - uint16_t
+//  [name] - the rest of the payload
+constexpr char ServerPlayerJoined = 'j';
+
+// 'l' - a player left:
+//  [id] - uint16_t
+constexpr char ServerPlayerLeft = 'l';
+
+// 's' - positions of the other players near this client, as a delta against an earlier snapshot (see Snapshot.hpp):
+//  [sequence] - varint (never 0)
+//  [baseline] - varint, sequence of the snapshot this is relative to (0 => none; start from no players)
+//  [removed count] - varint
+//  removed count x:
+//   [id] - varint (increasing)
+//  [changed count] - varint
+//  changed count x:
+//   [id] - varint (increasing)
+//   [position] - PositionFormat::size() bytes
+//  (players in the baseline that aren't mentioned are unchanged)
+constexpr char ServerSnapshot = 's';
+
+//largest message the server sends (and a client will accept, even once decompressed):
+// (room for an 's' or 'm' message about MaxPlayerId players; longer status messages are cut short)
+constexpr uint32_t MaxServerPayload = 1 << 21;
@@ -0,0 +1,107 @@
+#include "RingBuffer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+void RingBuffer::push(void const *data_, size_t size) {
+	reserve(size);
+	char const *data = reinterpret_cast< char const * >(data_);
+	Span spans[2];
+	uint32_t n = write_spans(spans);
+	for (uint32_t i = 0; i < n && size > 0; ++i) {
+		size_t amt = std::min(size, spans[i].size);
+		std::memcpy(spans[i].data, data, amt);
+		data += amt;
+		size -= amt;
+		commit(amt);
+	}
+	assert(size == 0);
+}
+
+void RingBuffer::pop(size_t size) {
+	assert(size <= count);
+	if (size >= count) {
+		//reset to the start of storage so the next writes are contiguous:
+		clear();
+	} else {
+		head = (head + size) & mask;
+		count -= size;
+	}
+}
+
+void RingBuffer::peek(size_t offset, void *dst_, size_t size) const {
+	assert(offset + size <= count);
+	if (size == 0) return; //(storage may not exist yet)
+	char *dst = reinterpret_cast< char * >(dst_);
+	size_t at = (head + offset) & mask;
+	size_t first = std::min(size, storage.size() - at);
+	std::memcpy(dst, storage.data() + at, first);
+	std::memcpy(dst + first, storage.data(), size - first);
+}
+
+std::string RingBuffer::peek_string(size_t offset, size_t size) const {
+	std::string ret(size, '\0');
+	peek(offset, &ret[0], size);
+	return ret;
+}
+
+void RingBuffer::reserve(size_t size) {
+	if (count + size <= storage.size()) return;
+
+	size_t new_size = std::max< size_t >(storage.size(), 256);
+	while (new_size < count + size) new_size *= 2;
+
+	//copy queued bytes to the start of the new storage:
+	std::vector< char > new_storage(new_size);
+	if (count > 0) peek(0, new_storage.data(), count);
+	storage.swap(new_storage);
+	mask = storage.size() - 1;
+	head = 0;
+}
+
+uint32_t RingBuffer::read_spans(Span spans[2]) {
+	return peek_spans(0, count, spans);
+}
+
+uint32_t RingBuffer::peek_spans(size_t offset, size_t size, Span spans[2]) {
+	assert(offset + size <= count);
+	if (size == 0) return 0;
+	size_t start = (head + offset) & mask;
+	size_t first = std::min(size, storage.size() - start);
+	spans[0].data = storage.data() + start;
+	spans[0].size = first;
+	if (first == size) return 1;
+	spans[1].data = storage.data();
+	spans[1].size = size - first;
+	return 2;
+}
+
+uint32_t RingBuffer::write_spans(Span spans[2]) {
+	size_t free = storage.size() - count;
+	if (free == 0) return 0;
+	size_t tail = (head + count) & mask;
+	size_t first = std::min(free, storage.size() - tail);
+	spans[0].data = storage.data() + tail;
+	spans[0].size = first;
+	if (first == free) return 1;
+	spans[1].data = storage.data();
+	spans[1].size = free - first;
+	return 2;
+}
+
+void RingBuffer::commit(size_t size) {
+	assert(count + size <= storage.size());
+	count += size;
+}
+
+char *RingBuffer::linearize() {
+	if (storage.empty()) return nullptr;
+	if (head + count > storage.size()) {
+		std::vector< char > new_storage(storage.size());
+		peek(0, new_storage.data(), count);
+		storage.swap(new_storage);
+		head = 0;
+	}
+	return storage.data() + head;
+}
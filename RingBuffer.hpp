@@ -0,0 +1,75 @@
+#pragma once
+
+/*
+ * RingBuffer is a growable FIFO of bytes, used as the storage for
+ *  Connection's send and receive queues.
+ *
+ * Bytes are appended at the back with push() (or written in place via
+ *  write_spans() + commit()) and consumed from the front with pop(),
+ *  which is O(1) -- nothing is moved when data is consumed.
+ * Storage is a power-of-two sized array that doubles when it fills up.
+ *
+ * Because the ring wraps, the readable (or writable) region may be split
+ *  into two contiguous spans; read_spans() and write_spans() expose these
+ *  directly so they can be handed to readv/writev-style calls.
+ *
+ */
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+struct RingBuffer {
+	//A contiguous run of bytes inside the ring:
+	struct Span {
+		char *data = nullptr;
+		size_t size = 0;
+	};
+
+	//number of bytes currently queued:
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	//number of bytes that fit without growing:
+	size_t capacity() const { return storage.size(); }
+
+	//byte access (index 0 is the front of the queue):
+	char &operator[](size_t i) { return storage[(head + i) & mask]; }
+	char const &operator[](size_t i) const { return storage[(head + i) & mask]; }
+
+	//append bytes at the back (grows as needed):
+	void push(void const *data, size_t size);
+	//discard bytes from the front:
+	void pop(size_t size);
+	//discard everything:
+	void clear() { head = 0; count = 0; }
+
+	//copy 'size' bytes starting 'offset' bytes from the front into 'dst':
+	void peek(size_t offset, void *dst, size_t size) const;
+	//helper that copies bytes out as a string:
+	std::string peek_string(size_t offset, size_t size) const;
+
+	//make sure at least 'size' more bytes can be pushed without growing:
+	void reserve(size_t size);
+
+	//fill 'spans' with (up to two) spans covering the queued bytes, front to back:
+	// returns the number of spans filled.
+	uint32_t read_spans(Span spans[2]);
+	//same, but covering just 'size' queued bytes starting 'offset' bytes from the front:
+	uint32_t peek_spans(size_t offset, size_t size, Span spans[2]);
+	//fill 'spans' with (up to two) spans covering the free space after the back:
+	// returns the number of spans filled. (call reserve() first to guarantee room)
+	uint32_t write_spans(Span spans[2]);
+	//mark 'size' bytes written into the space from write_spans() as queued:
+	void commit(size_t size);
+
+	//rearrange storage so the queued bytes are contiguous; returns a pointer to the front:
+	// (useful for debug dumps; avoid on hot paths since it may move all the data)
+	char *linearize();
+
+	//internals:
+	std::vector< char > storage; //size is zero or a power of two
+	size_t mask = 0; //storage.size() - 1
+	size_t head = 0; //index of front byte
+	size_t count = 0; //number of queued bytes
+};
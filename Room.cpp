@@ -0,0 +1,388 @@
+#include "Room.hpp"
+
+#include "Message.hpp"
+#include "Protocol.hpp"
+#include "Log.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cassert>
+#include <cstring>
+
+//get an empty buffer to serialize a new shared payload into:
+// (reuses the old buffer if no connection still has it queued)
+static void fresh_payload(std::shared_ptr< std::vector< char > > &payload) {
+	if (payload && payload.use_count() == 1) {
+		//(reactor threads drop their references with a release decrement; pair it with an acquire)
+		std::atomic_thread_fence(std::memory_order_acquire);
+		payload->clear();
+	} else {
+		payload = std::make_shared< std::vector< char > >();
+	}
+}
+
+static uint64_t ns_since(std::chrono::steady_clock::time_point before) {
+	return uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - before).count());
+}
+
+Room::PlayerInfo::PlayerInfo() {
+	static uint32_t next_player_number = 1; //(players are only made on the main thread)
+	name = "Player" + std::to_string(next_player_number);
+	next_player_number += 1;
+}
+
+void Room::Stats::merge(Stats const &other) {
+	snapshot_bytes.merge(other.snapshot_bytes);
+	full_snapshots += other.full_snapshots;
+	delta_snapshots += other.delta_snapshots;
+	near_players.merge(other.near_players);
+	far_players.merge(other.far_players);
+	datagrams += other.datagrams;
+	compress_messages += other.compress_messages;
+	compress_shrunk += other.compress_shrunk;
+	compress_bytes_in += other.compress_bytes_in;
+	compress_bytes_out += other.compress_bytes_out;
+	compress_ns += other.compress_ns;
+	departed_round_trips.rtt_us.merge(other.departed_round_trips.rtt_us);
+	departed_round_trips.jitter_us.merge(other.departed_round_trips.jitter_us);
+}
+
+Room::Room(Settings const &settings_) : settings(settings_),
+	interest_grid(settings_.level_min, settings_.level_max, settings_.far_radius) {
+}
+
+//------------------------------------------------
+//input:
+
+Room::PlayerHandle Room::add_player(ConnectionId connection, uint32_t datagram_token) {
+	uint32_t id;
+	if (free_player_ids.size() > PlayerIdReuseDelay || (next_player_id > MaxPlayerId && !free_player_ids.empty())) {
+		id = free_player_ids.front();
+		free_player_ids.pop_front();
+	} else if (next_player_id <= MaxPlayerId) {
+		id = next_player_id++;
+	} else {
+		return 0;
+	}
+	PlayerInfo info;
+	info.id = id;
+	info.connection = connection;
+	info.datagram_token = datagram_token;
+	return players.insert(std::move(info));
+}
+
+void Room::player_joined_message(PlayerInfo const &player, std::vector< char > *out) {
+	uint16_t id = uint16_t(player.id);
+	out->resize(MaxMessageHeaderSize);
+	out->resize(encode_message_header(out->data(), ServerPlayerJoined, uint32_t(sizeof(id) + player.name.size())));
+	out->insert(out->end(), reinterpret_cast< char const * >(&id), reinterpret_cast< char const * >(&id) + sizeof(id));
+	out->insert(out->end(), player.name.begin(), player.name.end());
+}
+
+void Room::introduce(PlayerHandle handle, ShardedServer *server) {
+	PlayerInfo const *joined = players.find(handle);
+	assert(joined);
+	if (!server) return;
+	player_joined_message(*joined, &joined_message);
+	for (PlayerInfo const &player : players) {
+		if (&player == joined) continue;
+		server->send(player.connection, joined_message.data(), joined_message.size());
+		player_joined_message(player, &message_scratch);
+		server->send(joined->connection, message_scratch.data(), message_scratch.size());
+	}
+}
+
+void Room::remove_player(PlayerHandle handle, ShardedServer *server) {
+	PlayerInfo *player = players.find(handle);
+	assert(player);
+	uint16_t id = uint16_t(player->id);
+	if (winner == handle) winner = 0;
+	stats.departed_round_trips.rtt_us.merge(player->round_trips.rtt_us);
+	stats.departed_round_trips.jitter_us.merge(player->round_trips.jitter_us);
+	free_player_ids.emplace_back(id);
+	players.erase(handle);
+
+	//tell everyone else:
+	if (!server) return;
+	char message[MaxMessageHeaderSize + sizeof(uint16_t)];
+	size_t header_size = encode_message_header(message, ServerPlayerLeft, sizeof(uint16_t));
+	std::memcpy(message + header_size, &id, sizeof(uint16_t));
+	for (PlayerInfo const &other : players) {
+		server->send(other.connection, message, header_size + sizeof(uint16_t));
+	}
+}
+
+void Room::handle_message(PlayerHandle handle, char const *data, size_t size, ShardedServer *server) {
+	PlayerInfo *found = players.find(handle);
+	assert(found);
+	PlayerInfo &player = *found;
+
+	MessageReader reader(data, size);
+	if (reader.header.type == ClientCapabilities) {
+		uint8_t flags = 0;
+		reader.read(&flags);
+		if (reader.failed || reader.remaining() != 0) {
+			LOG_WARN("'c' message from client is the wrong size; ignoring it.");
+			return;
+		}
+		player.compression = (flags & CapabilityCompression) != 0;
+		return;
+	}
+	if (reader.header.type == ClientPing) {
+		uint64_t received = monotonic_ns();
+		ClockSync::Ping ping;
+		reader.read(&ping.sent);
+		reader.read(&ping.echo);
+		reader.read(&ping.held);
+		if (reader.failed || reader.remaining() != 0) {
+			LOG_WARN("'q' message from client is the wrong size; ignoring it.");
+			return;
+		}
+		if (!server) return; //(replaying: the times are from the recording, and there's nobody to answer)
+		//round trip from the 'o' it echoes (measured on this clock alone):
+		if (ping.echo != 0 && received > ping.echo && received - ping.echo > ping.held) {
+			player.round_trips.add(received - ping.echo - ping.held);
+		}
+		//answer with an 'o':
+		char message[MaxMessageHeaderSize + ServerPongPayload];
+		size_t size = encode_message_header(message, ServerPong, ServerPongPayload);
+		uint64_t sent = monotonic_ns();
+		std::memcpy(message + size, &ping.sent, sizeof(uint64_t));
+		std::memcpy(message + size + 8, &received, sizeof(uint64_t));
+		std::memcpy(message + size + 16, &sent, sizeof(uint64_t));
+		server->send(player.connection, message, size + ServerPongPayload);
+		return;
+	}
+	if (reader.header.type == ClientSnapshotAck) {
+		uint32_t sequence = 0;
+		reader.read_varint(&sequence);
+		if (reader.failed || reader.remaining() != 0) {
+			LOG_WARN("'a' message from client is the wrong size; ignoring it.");
+			return;
+		}
+		//(acks for snapshots that haven't been sent yet are ignored; comparisons are wrap-around safe)
+		if (sequence != 0 && int32_t(snapshot_sequence - sequence) >= 0
+		 && (player.acked_snapshot == 0 || int32_t(sequence - player.acked_snapshot) > 0)) {
+			player.acked_snapshot = sequence;
+		}
+		return;
+	}
+	assert(reader.header.type == ClientState);
+	uint8_t num_pies_collected = 0;
+	uint8_t flag = 0;
+	char position[PositionFormat::MaxSize];
+	reader.read(&num_pies_collected);
+	reader.read(&flag);
+	reader.read(position, settings.position_format.size());
+	if (reader.failed || reader.remaining() != 0) {
+		LOG_WARN("'b' message from client is the wrong size; ignoring it.");
+		return;
+	}
+	if (flag == 1) {
+		winner = handle;
+	}
+
+	player.num_pies_collected = num_pies_collected;
+	//(the client only sends 'b' with a current position -- when datagrams aren't acked, or along with a pie count change)
+	player.position = settings.position_format.decode(position);
+}
+
+void Room::handle_datagram(PlayerHandle handle, char const *data, ShardedServer *server) {
+	PlayerInfo *found = players.find(handle);
+	assert(found);
+	PlayerInfo &player = *found;
+	uint32_t sequence = (uint32_t(uint8_t(data[5])) << 24) | (uint32_t(uint8_t(data[6])) << 16) | (uint32_t(uint8_t(data[7])) << 8) | uint32_t(uint8_t(data[8]));
+	//drop duplicates and datagrams that arrived after newer ones:
+	// (comparison is wrap-around safe)
+	if (player.has_datagrams && int32_t(sequence - player.datagram_sequence) <= 0) return;
+	player.has_datagrams = true;
+	player.datagram_sequence = sequence;
+	stats.datagrams += 1;
+	player.position = settings.position_format.decode(data + 9);
+
+	//let the client know datagrams are getting through (it sends positions in 'b' messages until they are):
+	if (!server) return; //(replaying)
+	uint64_t now = monotonic_ns();
+	if (player.datagram_acked_at != 0 && now - player.datagram_acked_at < uint64_t(DatagramAckInterval * 1e9)) return;
+	player.datagram_acked_at = now;
+	char message[MaxMessageHeaderSize + ServerDatagramAckPayload];
+	size_t size = encode_message_header(message, ServerDatagramAck, ServerDatagramAckPayload);
+	std::memcpy(message + size, &sequence, sizeof(uint32_t));
+	server->send(player.connection, message, size + ServerDatagramAckPayload);
+}
+
+//------------------------------------------------
+//tick:
+
+void Room::compress(char const *message, size_t size, std::vector< char > *out) {
+	out->clear();
+	if (settings.compress_min == 0 || size < settings.compress_min) return;
+	auto before = std::chrono::steady_clock::now();
+	bool shrunk = compress_message(message, size, out);
+	stats.compress_ns += ns_since(before);
+	stats.compress_messages += 1;
+	stats.compress_bytes_in += size;
+	if (shrunk) {
+		stats.compress_shrunk += 1;
+		stats.compress_bytes_out += out->size();
+	} else {
+		stats.compress_bytes_out += size;
+	}
+}
+
+void Room::simulate() {
+	auto before = std::chrono::steady_clock::now();
+
+	status_message = "";
+	if (PlayerInfo const *won = players.find(winner)) {
+		status_message = won->name + " wins! ";
+	} else {
+		for (PlayerInfo const &player : players) {
+			if (status_message != "") status_message += " + ";
+			status_message += "( " + player.name + ": " + std::to_string(player.num_pies_collected) + " ) ";
+		}
+	}
+	if (status_message.size() > MaxServerPayload) status_message.resize(MaxServerPayload); //(see Protocol.hpp)
+	LOG_TRACE("status: " << status_message);
+
+	work_ns = ns_since(before);
+}
+
+void Room::serialize() {
+	auto before = std::chrono::steady_clock::now();
+	PositionFormat const &position_format = settings.position_format;
+
+	//serialize the status message once for everyone:
+	fresh_payload(status_payload);
+	{
+		char header[MaxMessageHeaderSize];
+		size_t header_size = encode_message_header(header, ServerStatus, uint32_t(status_message.size()));
+		status_payload->reserve(header_size + status_message.size());
+		status_payload->insert(status_payload->end(), header, header + header_size);
+		status_payload->insert(status_payload->end(), status_message.begin(), status_message.end());
+	}
+	fresh_payload(compressed_status_payload);
+	compress(status_payload->data(), status_payload->size(), compressed_status_payload.get());
+
+	//record this tick's snapshot of the players:
+	snapshot_sequence += 1;
+	if (snapshot_sequence == 0) snapshot_sequence = 1; //(0 means "no snapshot")
+	snapshot.sequence = snapshot_sequence;
+	snapshot.players.resize(players.size());
+	{
+		auto out = snapshot.players.begin();
+		for (PlayerInfo const &player : players) {
+			out->id = player.id;
+			out->position = player.position;
+			++out;
+		}
+	}
+	std::sort(snapshot.players.begin(), snapshot.players.end(), [](Snapshot::Player const &a, Snapshot::Player const &b) {
+		return a.id < b.id;
+	});
+	snapshot_positions.resize(snapshot.players.size());
+	for (uint32_t i = 0; i < snapshot.players.size(); ++i) {
+		snapshot_positions[i] = snapshot.players[i].position;
+	}
+	interest_grid.build(snapshot_positions);
+
+	//build updated game state for all clients:
+	// Each player receives the status message ('m') and its view of the other players ('s', relative to the view it last acked).
+	// A player's view is the other players within far_radius of it; those within near_radius have
+	// their current positions, the rest only get a new position every far_interval ticks.
+
+	float near2 = settings.near_radius * settings.near_radius;
+	float far2 = settings.far_radius * settings.far_radius;
+
+	for (PlayerInfo &player : players) {
+		//find the players relevant to this one:
+		relevant.clear();
+		interest_grid.query(player.position, settings.far_radius, [&](uint32_t i){
+			Snapshot::Player const &other = snapshot.players[i];
+			if (other.id == player.id) return;
+			glm::vec3 to = other.position - player.position;
+			float dis2 = glm::dot(to, to);
+			if (dis2 <= far2) relevant.emplace_back(i, dis2 <= near2);
+		});
+		std::sort(relevant.begin(), relevant.end()); //(index order is id order)
+
+		//build this tick's view, keeping old positions for farther players that aren't due for an update:
+		Snapshot const &previous = player.views[(snapshot_sequence - 1) % SnapshotHistory];
+		bool have_previous = (previous.sequence == snapshot_sequence - 1 && previous.sequence != 0);
+		Snapshot &view = player.views[snapshot_sequence % SnapshotHistory];
+		view.sequence = snapshot_sequence;
+		view.players.resize(relevant.size());
+		uint32_t near_count = 0;
+		auto prev = previous.players.begin();
+		for (uint32_t i = 0; i < relevant.size(); ++i) {
+			Snapshot::Player const &current = snapshot.players[relevant[i].first];
+			view.players[i] = current;
+			if (relevant[i].second) {
+				near_count += 1;
+				continue;
+			}
+			if ((snapshot_sequence + current.id) % settings.far_interval == 0) continue; //(due; staggered by id)
+			if (!have_previous) continue;
+			while (prev != previous.players.end() && prev->id < current.id) ++prev;
+			if (prev != previous.players.end() && prev->id == current.id) {
+				view.players[i].position = prev->position;
+			}
+		}
+		stats.near_players.add(near_count);
+		stats.far_players.add(relevant.size() - near_count);
+
+		//use the acked view as a baseline, if it's still around:
+		Snapshot const *baseline = nullptr;
+		if (player.acked_snapshot != 0 && player.views[player.acked_snapshot % SnapshotHistory].sequence == player.acked_snapshot) {
+			assert(snapshot_sequence - player.acked_snapshot < SnapshotHistory);
+			baseline = &player.views[player.acked_snapshot % SnapshotHistory];
+		}
+		SnapshotDelta &delta = player.delta;
+		fresh_payload(delta.records);
+		delta.encode(baseline, view, position_format);
+		if (baseline == nullptr) stats.full_snapshots += 1;
+		else stats.delta_snapshots += 1;
+
+		size_t skip_begin, skip_end;
+		delta.message_header(player.id, &player.snapshot_header, &skip_begin, &skip_end);
+		assert(skip_begin == skip_end); //(the player is never in its own view)
+		player.compressed_snapshot.clear();
+		if (player.compression) {
+			snapshot_message.assign(player.snapshot_header.begin(), player.snapshot_header.end());
+			snapshot_message.insert(snapshot_message.end(), delta.records->begin(), delta.records->end());
+			compress(snapshot_message.data(), snapshot_message.size(), &player.compressed_snapshot);
+		}
+	}
+
+	work_ns += ns_since(before);
+}
+
+void Room::flush(ShardedServer *server) {
+	//send updated game state to all clients:
+	// Both messages are superseded by the next tick's, so slow connections only get the newest (see ShardedServer::send).
+	// (a superseded 's' is never acked, so later deltas don't depend on it)
+	for (PlayerInfo &player : players) {
+		ConnectionId c = player.connection;
+		if (!player.compressed_snapshot.empty()) {
+			stats.snapshot_bytes.add(player.compressed_snapshot.size());
+		} else {
+			stats.snapshot_bytes.add(player.snapshot_header.size() + player.delta.records->size());
+		}
+		if (!server) continue; //(replaying; nobody to send to)
+
+		if (player.compression && !compressed_status_payload->empty()) {
+			server->send_shared(c, compressed_status_payload, 0, compressed_status_payload->size(), 1, ServerStatus);
+		} else {
+			server->send_shared(c, status_payload, 0, status_payload->size(), 1, ServerStatus);
+		}
+
+		if (!player.compressed_snapshot.empty()) {
+			server->send(c, player.compressed_snapshot.data(), player.compressed_snapshot.size(), 1, ServerSnapshot);
+		} else {
+			SnapshotDelta const &delta = player.delta;
+			server->send(c, player.snapshot_header.data(), player.snapshot_header.size(), 0, ServerSnapshot);
+			server->send_shared(c, delta.records, 0, delta.records->size(), 1, ServerSnapshot);
+		}
+	}
+}
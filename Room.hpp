@@ -0,0 +1,178 @@
+#pragma once
+
+/*
+ * Room is one match: a set of players who only see (and race) each other,
+ *  with its own winner, status message, player ids, and snapshot sequence.
+ *  A server process hosts any number of rooms (see server.cpp), and routes
+ *  each connection to one when it connects.
+ *
+ * Rooms share nothing, so their ticks can run in parallel:
+ *  - input (add_player(), handle_message(), ...) is handed to a room on the
+ *    main thread, as it arrives;
+ *  - simulate() and serialize() -- most of a tick's work -- may run on any
+ *    thread (e.g., a WorkerPool's), one thread per room at a time;
+ *  - flush() hands the tick's messages to the network on the main thread
+ *    again (ShardedServer is only ever used from the main thread).
+ *
+ * Functions that send take a ShardedServer pointer that is null when
+ *  replaying a tick log (the room then does everything but send).
+ *
+ * For example:
+
+Room room(settings);
+Room::PlayerHandle handle = room.add_player(connection, token);
+room.introduce(handle, &server);
+room.handle_message(handle, data, size, &server);
+//each tick:
+room.simulate();
+room.serialize();
+room.flush(&server);
+//...
+room.remove_player(handle, &server);
+
+ */
+
+#include "ShardedServer.hpp"
+#include "Snapshot.hpp"
+#include "PositionFormat.hpp"
+#include "InterestGrid.hpp"
+#include "ClockSync.hpp"
+#include "Histogram.hpp"
+#include "SlotMap.hpp"
+
+#include <glm/glm.hpp>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+struct Room {
+	//settings shared by every room:
+	struct Settings {
+		PositionFormat position_format; //(positions on the wire)
+		//xy bounding box of the level (players outside it still work, but the interest grid only divides up this area):
+		glm::vec2 level_min = glm::vec2(0.0f);
+		glm::vec2 level_max = glm::vec2(0.0f);
+		//interest management -- other players within near_radius are sent every tick, those within far_radius
+		// every far_interval ticks, and those farther away not at all:
+		float near_radius = 20.0f;
+		float far_radius = 40.0f;
+		uint32_t far_interval = 3;
+		uint32_t compress_min = 128; //messages of at least this many bytes are compressed, for clients that can take it (0 => never)
+	};
+	Room(Settings const &settings);
+	Room(Room const &) = delete;
+
+	//per-client state:
+	struct PlayerInfo {
+		PlayerInfo();
+		uint32_t id = 0; //identifies this player in 'j', 'l', and 's' messages (see Protocol.hpp)
+		std::string name;
+		ConnectionId connection = 0;
+
+		uint32_t num_pies_collected = 0;
+		uint32_t flag = 0;
+
+		int32_t total = 0;
+
+		glm::vec3 position = glm::vec3(0.0f);
+
+		//position datagrams from this player are identified by this (random) token:
+		uint32_t datagram_token = 0;
+		bool has_datagrams = false; //a datagram has arrived (so datagram_sequence means something)
+		uint32_t datagram_sequence = 0; //sequence number of the newest datagram so far
+		uint64_t datagram_acked_at = 0; //monotonic_ns() when the last 'd' was sent (0 => never)
+
+		//what this client was sent in the last SnapshotHistory ticks (its "view" of the other players; see Snapshot.hpp),
+		// indexed by sequence % SnapshotHistory:
+		std::vector< Snapshot > views = std::vector< Snapshot >(SnapshotHistory);
+		//newest of those the client has acked (0 => none; send everything):
+		uint32_t acked_snapshot = 0;
+		//this tick's 's' message -- header + delta.records, or (if it shrank) compressed into a 'z' message:
+		SnapshotDelta delta;
+		std::vector< char > snapshot_header;
+		std::vector< char > compressed_snapshot; //(empty => not compressed)
+
+		bool compression = false; //client understands 'z' messages (from its 'c' message)
+
+		//latency to this client, measured with its pings (see ClockSync.hpp):
+		RoundTrips round_trips;
+	};
+	typedef SlotMap< PlayerInfo >::Handle PlayerHandle;
+	SlotMap< PlayerInfo > players;
+
+	//add a player for 'connection', whose position datagrams are tagged with 'datagram_token':
+	// returns 0 if every player id is in use
+	PlayerHandle add_player(ConnectionId connection, uint32_t datagram_token);
+	//introduce a new player to everyone else, and everyone else to them ('j' messages):
+	void introduce(PlayerHandle handle, ShardedServer *server);
+	//remove a player, and tell everyone else ('l' message):
+	void remove_player(PlayerHandle handle, ShardedServer *server);
+
+	//'data' is a complete 'b', 'a', 'c', or 'q' message from the player:
+	void handle_message(PlayerHandle handle, char const *data, size_t size, ShardedServer *server);
+	//'data' is a position datagram from the player (see server.cpp; its size and token have been checked):
+	// (acks it with a 'd' message, now and then; see Protocol.hpp)
+	void handle_datagram(PlayerHandle handle, char const *data, ShardedServer *server);
+
+	//a tick:
+	void simulate(); //update game state
+	void serialize(); //record this tick's snapshot, and build every player's messages
+	void flush(ShardedServer *server); //send the messages
+
+	//every player, as of the last serialize() (sorted by id, as in a Snapshot):
+	Snapshot snapshot;
+
+	//stats (connection and socket stats are kept by ShardedServer):
+	struct Stats {
+		Histogram snapshot_bytes; //size of each client's 's' message
+		uint64_t full_snapshots = 0; //'s' messages sent without a baseline
+		uint64_t delta_snapshots = 0; //'s' messages sent relative to an acked snapshot
+		Histogram near_players; //players each client got each tick (at full rate)
+		Histogram far_players; //players each client has in its view at a reduced rate
+		uint64_t datagrams = 0; //position datagrams accepted
+		//messages at least compress_min bytes, and what compressing them did:
+		uint64_t compress_messages = 0;
+		uint64_t compress_shrunk = 0; //(the rest were sent as-is)
+		uint64_t compress_bytes_in = 0;
+		uint64_t compress_bytes_out = 0; //(of the ones that shrunk; the others count as their original size)
+		uint64_t compress_ns = 0;
+		//round trips (and their jitter) of players that have left, so latency reports cover everyone:
+		// (current players' are in their PlayerInfo)
+		RoundTrips departed_round_trips;
+
+		void merge(Stats const &other);
+	} stats;
+	uint64_t work_ns = 0; //how long the last simulate() + serialize() took
+
+	//internals:
+	Settings settings;
+	PlayerHandle winner = 0; //(0 => nobody has won)
+	std::string status_message;
+
+	//player ids that have been freed, oldest first (an id is only reused once PlayerIdReuseDelay
+	// others have been freed after it, so a held-back snapshot rarely names a new player by an old id):
+	std::deque< uint16_t > free_player_ids;
+	static constexpr size_t PlayerIdReuseDelay = 256;
+	uint32_t next_player_id = 1; //(ids from here to MaxPlayerId haven't been used yet)
+
+	//payloads shared (not copied) by every client's message each tick:
+	std::shared_ptr< std::vector< char > > status_payload; //'m' header + status message
+	std::shared_ptr< std::vector< char > > compressed_status_payload; //the same, compressed into a 'z' message (empty => didn't shrink)
+
+	uint32_t snapshot_sequence = 0; //sequence of the newest snapshot
+	InterestGrid interest_grid; //(for finding the players near each player)
+	std::vector< glm::vec3 > snapshot_positions; //(positions of snapshot.players, for the interest grid)
+	//(scratch space:)
+	std::vector< std::pair< uint32_t, bool > > relevant; //index in snapshot.players, is near
+	std::vector< char > snapshot_message; //(for compressing 's' messages)
+	std::vector< char > joined_message, message_scratch; //(for 'j' messages)
+
+	//write a 'j' message introducing 'player':
+	static void player_joined_message(PlayerInfo const &player, std::vector< char > *out);
+	//compress 'message' (a whole message) into a 'z' message in '*out' if it's big enough and that makes it smaller:
+	// ('*out' is left empty otherwise)
+	void compress(char const *message, size_t size, std::vector< char > *out);
+};
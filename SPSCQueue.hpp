@@ -0,0 +1,68 @@
+#pragma once
+
+/*
+ * SPSCQueue is a bounded, lock-free queue for handing values from exactly
+ *  one producer thread to exactly one consumer thread.
+ *
+ * try_push() (producer only) and try_pop() (consumer only) never block;
+ *  they return false when the queue is full or empty, respectively.
+ *
+ */
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <cassert>
+
+template< typename T >
+struct SPSCQueue {
+	//capacity is rounded up to a power of two:
+	explicit SPSCQueue(size_t capacity_) {
+		size_t capacity = 2;
+		while (capacity < capacity_) capacity *= 2;
+		slots.resize(capacity);
+		mask = capacity - 1;
+	}
+	SPSCQueue(SPSCQueue const &) = delete;
+	SPSCQueue &operator=(SPSCQueue const &) = delete;
+
+	//(producer) move 'value' into the queue; returns false (leaving 'value' alone) if full:
+	bool try_push(T &&value) {
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head_cache == slots.size()) {
+			head_cache = head.load(std::memory_order_acquire);
+			if (t - head_cache == slots.size()) return false;
+		}
+		slots[t & mask] = std::move(value);
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	//(consumer) move the front value into '*value'; returns false if empty:
+	bool try_pop(T *value) {
+		assert(value);
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail_cache) {
+			tail_cache = tail.load(std::memory_order_acquire);
+			if (h == tail_cache) return false;
+		}
+		*value = std::move(slots[h & mask]);
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	//approximate number of queued values (exact when called from either end with the other idle):
+	size_t size() const {
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+
+	//internals:
+	std::vector< T > slots;
+	size_t mask = 0;
+	//head is written by the consumer, tail by the producer; each side caches the other's
+	// index and keeps its own on a separate cache line to avoid false sharing:
+	alignas(64) std::atomic< size_t > head{0};
+	size_t tail_cache = 0; //(consumer) last seen value of tail
+	alignas(64) std::atomic< size_t > tail{0};
+	size_t head_cache = 0; //(producer) last seen value of head
+};
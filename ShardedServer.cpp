@@ -0,0 +1,358 @@
+#include "ShardedServer.hpp"
+#include "Log.hpp"
+
+#include <iostream>
+#include <chrono>
+#include <cassert>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+
+//queue capacities (per shard); a full queue makes the producer wait:
+// (a reactor waiting on a full inbound queue relies on the game thread draining it -- which it does
+//  even while it is itself waiting on a full outbound queue; see push())
+constexpr size_t InboundCapacity = 1 << 16;
+constexpr size_t OutboundCapacity = 1 << 16;
+
+//reactor threads sleep in poll() until the game thread pushes something (see Shard::sleeping);
+// if their Server can't be woken (see Server::enable_wake()), they re-check their outbound queue this often (seconds):
+constexpr double ReactorPollTimeout = 0.0005;
+
+//push, yielding until there is room:
+template< typename T >
+static void push_wait(SPSCQueue< T > &queue, T &&value) {
+	while (!queue.try_push(std::move(value))) {
+		std::this_thread::yield();
+	}
+}
+
+ShardedServer::Shard::Shard(std::string const &port, bool reuse_port, uint32_t index_, uint32_t count_)
+	: server(port, reuse_port), index(index_), count(count_),
+	  inbound(InboundCapacity), outbound(OutboundCapacity) {
+}
+
+//(shards' slots are interleaved, so ids stay dense no matter which shards connections land on)
+ConnectionId ShardedServer::Shard::to_id(SlotMap< Open >::Handle handle) const {
+	uint32_t slot = SlotMap< Open >::slot_of(handle) * count + index;
+	assert(slot < SlotMap< Open >::MaxSlots);
+	return SlotMap< Open >::make_handle(slot, SlotMap< Open >::generation_of(handle));
+}
+
+SlotMap< ShardedServer::Shard::Open >::Handle ShardedServer::Shard::to_handle(ConnectionId id) const {
+	assert(SlotMap< Open >::slot_of(id) % count == index);
+	return SlotMap< Open >::make_handle(SlotMap< Open >::slot_of(id) / count, SlotMap< Open >::generation_of(id));
+}
+
+void ShardedServer::Shard::poll(Framer const &framer, EventHandler const &deliver, double timeout) {
+	server.poll([&](Connection *c, Connection::Event evt){
+		if (evt == Connection::OnOpen) {
+			Open state;
+			state.connection = c;
+			c->tag = open.insert(std::move(state));
+			deliver(to_id(c->tag), Connection::OnOpen, nullptr, 0);
+		} else if (evt == Connection::OnClose) {
+			ConnectionId id = to_id(c->tag);
+			forget(c);
+			deliver(id, Connection::OnClose, nullptr, 0);
+		} else { assert(evt == Connection::OnRecv);
+			assert(open.find(c->tag));
+			ConnectionId id = to_id(c->tag);
+			//split recv_buffer into messages:
+			while (true) {
+				size_t size = framer(c->recv_buffer);
+				if (size == 0) break;
+				if (size == Reject || size > c->recv_buffer.size()) {
+					LOG_WARN("[ShardedServer] rejecting garbage from connection " << id << ".");
+					c->close();
+					forget(c);
+					deliver(id, Connection::OnClose, nullptr, 0);
+					return;
+				}
+				message.resize(size);
+				c->recv_buffer.peek(0, message.data(), size);
+				c->recv_buffer.pop(size);
+				c->stats.messages_in += 1;
+				deliver(id, Connection::OnRecv, message.data(), size);
+				if (!*c) return; //closed by the handler (inline mode)
+			}
+		}
+	}, timeout);
+
+	if (held_messages) release_held();
+}
+
+void ShardedServer::Shard::forget(Connection *c) {
+	Open *state = open.find(c->tag);
+	assert(state);
+	for (Held const &h : state->held) {
+		if (!h.pieces.empty() && h.state != Held::Holding) held_messages -= 1;
+	}
+	open.erase(c->tag);
+}
+
+void ShardedServer::Shard::apply(Outbound &&out) {
+	Open *state = open.find(to_handle(out.id));
+	if (!state) return; //connection already gone
+	Connection *c = state->connection;
+	if (out.kind == Outbound::Close) {
+		c->close();
+		forget(c);
+		//(OnClose is delivered by the caller)
+		return;
+	}
+
+	if (out.coalesce) {
+		std::vector< Held > &list = state->held;
+		auto h = std::find_if(list.begin(), list.end(), [&](Held const &h){ return h.coalesce == out.coalesce; });
+		if (h == list.end()) {
+			list.emplace_back();
+			list.back().coalesce = out.coalesce;
+			h = list.end() - 1;
+		}
+		if (h->state == Held::Between) {
+			//a new message; hold it back if the connection is backed up
+			// (or if an older message is still held, so they don't go out of order):
+			if (c->send_backed_up || !h->pieces.empty()) {
+				if (!h->pieces.empty()) {
+					c->stats.messages_superseded += 1;
+					h->pieces.clear();
+					held_messages -= 1;
+				}
+				h->state = Held::Holding;
+			} else {
+				h->state = Held::Direct;
+			}
+		}
+		bool last = (out.messages > 0);
+		if (h->state == Held::Holding) {
+			h->pieces.emplace_back(std::move(out));
+			if (last) {
+				h->state = Held::Between;
+				held_messages += 1;
+			}
+			return;
+		}
+		if (last) h->state = Held::Between;
+	}
+	queue(c, std::move(out));
+}
+
+void ShardedServer::Shard::queue(Connection *c, Outbound &&out) {
+	if (out.kind == Outbound::Send) {
+		if (out.inline_size) c->send_raw(out.inline_data, out.inline_size);
+		else c->send_raw(out.data.data(), out.data.size());
+	} else { assert(out.kind == Outbound::SendShared);
+		c->send_shared(out.payload, out.begin, out.end);
+	}
+	c->stats.messages_out += out.messages;
+}
+
+void ShardedServer::Shard::release_held() {
+	for (Open &state : open) {
+		Connection *c = state.connection;
+		if (c->send_backed_up) continue;
+		for (Held &h : state.held) {
+			if (h.state == Held::Holding || h.pieces.empty()) continue; //(nothing held, or newest message still arriving)
+			for (Outbound &piece : h.pieces) {
+				queue(c, std::move(piece));
+			}
+			h.pieces.clear();
+			held_messages -= 1;
+		}
+	}
+}
+
+void ShardedServer::Shard::publish_stats() {
+	std::lock_guard< std::mutex > lock(stats_mutex);
+	published_stats.poll = server.stats;
+	published_stats.connections.clear();
+	for (Open const &state : open) {
+		published_stats.connections.emplace_back(to_id(state.connection->tag), state.connection->stats);
+	}
+	published_at = std::chrono::steady_clock::now();
+}
+
+ShardedServer::ShardedServer(std::string const &port, uint32_t threads, Framer const &framer_) : framer(framer_) {
+	if (threads > 255) throw std::runtime_error("ShardedServer supports at most 255 reactor threads.");
+
+	threaded = (threads > 0);
+	if (!threaded) {
+		shards.emplace_back(std::make_unique< Shard >(port, false, 0, 1));
+		return;
+	}
+
+	for (uint32_t i = 0; i < threads; ++i) {
+		shards.emplace_back(std::make_unique< Shard >(port, true, i, threads));
+		shards.back()->can_wake = shards.back()->server.enable_wake();
+	}
+	for (auto &shard_ptr : shards) {
+		Shard &shard = *shard_ptr;
+		shard.thread = std::thread([this, &shard](){
+			//events go to the game thread through the inbound queue:
+			EventHandler deliver = [&shard](ConnectionId id, Connection::Event evt, char const *data, size_t size) {
+				Inbound in;
+				in.id = id;
+				in.event = evt;
+				in.data.assign(data, data + size);
+				push_wait(shard.inbound, std::move(in));
+			};
+			Outbound out;
+			while (!stop.load(std::memory_order_relaxed)) {
+				while (shard.outbound.try_pop(&out)) {
+					bool close = (out.kind == Outbound::Close);
+					ConnectionId id = out.id;
+					bool known = shard.open.find(shard.to_handle(id));
+					shard.apply(std::move(out));
+					if (close && known) deliver(id, Connection::OnClose, nullptr, 0);
+					out.payload.reset(); //don't hold on to shared payloads
+				}
+				double timeout = ReactorPollTimeout;
+				if (shard.can_wake) {
+					//announce the sleep, then re-check the queue (pairs with the fence in wake()):
+					shard.sleeping.store(true, std::memory_order_relaxed);
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+					if (shard.outbound.size() == 0 && !stop.load(std::memory_order_relaxed)) timeout = StatsInterval;
+				}
+				shard.poll(framer, deliver, timeout);
+				shard.sleeping.store(false, std::memory_order_relaxed);
+				if (std::chrono::steady_clock::now() - shard.published_at > std::chrono::duration< double >(StatsInterval)) {
+					shard.publish_stats();
+				}
+			}
+		});
+	}
+	std::cout << "[ShardedServer] running " << threads << " reactor threads." << std::endl;
+}
+
+ShardedServer::~ShardedServer() {
+	stop = true;
+	for (auto &shard : shards) {
+		shard->server.wake();
+	}
+	for (auto &shard : shards) {
+		if (shard->thread.joinable()) shard->thread.join();
+	}
+}
+
+void ShardedServer::poll(EventHandler const &on_event, double timeout) {
+	if (!threaded) {
+		for (ConnectionId id : pending_closes) {
+			on_event(id, Connection::OnClose, nullptr, 0);
+		}
+		pending_closes.clear();
+		shards[0]->poll(framer, on_event, timeout);
+		return;
+	}
+
+	//events taken off the queues by push() go first, since the ones still queued came after them:
+	// (a handler's push() may take more, so check again after every event)
+	auto deliver_backlog = [&]() {
+		while (!backlog.empty()) {
+			Inbound in = std::move(backlog.front());
+			backlog.pop_front();
+			on_event(in.id, in.event, in.data.data(), in.data.size());
+		}
+	};
+	auto drain = [&]() {
+		bool any = !backlog.empty();
+		deliver_backlog();
+		Inbound in;
+		for (auto &shard : shards) {
+			while (shard->inbound.try_pop(&in)) {
+				on_event(in.id, in.event, in.data.data(), in.data.size());
+				any = true;
+				deliver_backlog();
+			}
+		}
+		return any;
+	};
+
+	if (drain() || timeout <= 0.0) return;
+	//nothing yet; wait a little (messages are only acted on at tick boundaries anyway):
+	std::this_thread::sleep_for(std::chrono::duration< double >(std::min(timeout, 0.001)));
+	drain();
+}
+
+ShardedServer::Shard &ShardedServer::shard_for(ConnectionId id) {
+	return *shards[SlotMap< Shard::Open >::slot_of(id) % shards.size()];
+}
+
+void ShardedServer::push(Outbound &&out) {
+	Shard &shard = shard_for(out.id);
+	if (!threaded) {
+		shard.apply(std::move(out));
+		return;
+	}
+	while (!shard.outbound.try_push(std::move(out))) {
+		//the reactor is behind -- and may itself be waiting for room in its inbound queue, so
+		// keep that queue moving (poll() delivers what was taken) rather than waiting on each other:
+		Inbound in;
+		while (shard.inbound.try_pop(&in)) {
+			backlog.emplace_back(std::move(in));
+		}
+		wake(shard);
+		std::this_thread::yield();
+	}
+	wake(shard);
+}
+
+void ShardedServer::wake(Shard &shard) {
+	//(pairs with the fence in the reactor loop: either it sees the pushed value, or this sees it sleeping)
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (shard.sleeping.load(std::memory_order_relaxed) && shard.sleeping.exchange(false, std::memory_order_relaxed)) {
+		shard.server.wake();
+	}
+}
+
+void ShardedServer::send(ConnectionId id, void const *data, size_t size, uint32_t messages, char coalesce) {
+	Outbound out;
+	out.kind = Outbound::Send;
+	out.messages = uint8_t(messages);
+	out.coalesce = coalesce;
+	out.id = id;
+	if (size <= Outbound::InlineSize && size > 0) {
+		std::memcpy(out.inline_data, data, size);
+		out.inline_size = uint8_t(size);
+	} else {
+		out.data.assign(reinterpret_cast< char const * >(data), reinterpret_cast< char const * >(data) + size);
+	}
+	push(std::move(out));
+}
+
+void ShardedServer::send_shared(ConnectionId id, SharedPayload const &payload, size_t begin, size_t end, uint32_t messages, char coalesce) {
+	Outbound out;
+	out.kind = Outbound::SendShared;
+	out.messages = uint8_t(messages);
+	out.coalesce = coalesce;
+	out.id = id;
+	out.payload = payload;
+	out.begin = begin;
+	out.end = end;
+	push(std::move(out));
+}
+
+void ShardedServer::close(ConnectionId id) {
+	Outbound out;
+	out.kind = Outbound::Close;
+	out.id = id;
+	if (!threaded) {
+		Shard &shard = shard_for(id);
+		bool known = shard.open.find(shard.to_handle(id));
+		shard.apply(std::move(out));
+		//NOTE: in inline mode the OnClose for a game-requested close is reported on the next poll():
+		if (known) pending_closes.emplace_back(id);
+	} else {
+		push(std::move(out));
+	}
+}
+
+void ShardedServer::collect_stats(std::vector< ShardStats > *stats) {
+	assert(stats);
+	stats->resize(shards.size());
+	for (size_t i = 0; i < shards.size(); ++i) {
+		Shard &shard = *shards[i];
+		if (!threaded) shard.publish_stats(); //(inline mode: the shard is ours to read)
+		std::lock_guard< std::mutex > lock(shard.stats_mutex);
+		(*stats)[i] = shard.published_stats;
+	}
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+/*
+ * ShardedServer spreads a server's socket work across several reactor threads.
+ *
+ * Each reactor thread owns its own Server (an SO_REUSEPORT listener plus its
+ *  own set of connections), so accept, recv, message framing and send all
+ *  happen off the game thread. Complete messages are handed to the game
+ *  thread through lock-free single-producer/single-consumer queues, and
+ *  outgoing data travels back to the owning reactor the same way. Reactors
+ *  sleep in epoll until there is socket work or the game thread pushes
+ *  something (which signals an eventfd; see Server::wake()).
+ *
+ * When a queue is full its producer waits, but the game thread never waits
+ *  on a reactor that is waiting on it: while push() waits for room in a
+ *  shard's outbound queue it keeps taking that shard's inbound events (to be
+ *  delivered by the next poll()).
+ *
+ * Connections are named by ConnectionId rather than Connection *, since the
+ *  Connection objects live on (and are only touched by) their reactor thread.
+ *  ConnectionIds are generational handles (see SlotMap.hpp) whose slot numbers
+ *  are dense across all shards, so the game can keep its per-connection state
+ *  in a SlotMap under the same ids (with insert_at()); ids of closed
+ *  connections are recognized as stale rather than reaching a newer connection.
+ *
+ * With threads == 0 there are no reactor threads: poll() runs a single Server
+ *  inline on the calling thread, just like Server::poll().
+ *
+ * For example:
+
+ShardedServer server("1337", 4, [](RingBuffer const &buffer) -> size_t {
+	//return size of the message at the front of buffer (or 0 if incomplete, ShardedServer::Reject if garbage)
+});
+while (true) {
+	server.poll([&](ConnectionId id, Connection::Event evt, char const *data, size_t size){
+		//...
+		server.send(id, "ok", 2);
+	}, 0.01);
+}
+
+ */
+
+#include "Connection.hpp"
+#include "SPSCQueue.hpp"
+#include "SlotMap.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <chrono>
+#include <deque>
+
+//ShardedServer's name for a connection: a SlotMap handle, whose slot is (slot in the shard) * (shard count) + (shard index):
+typedef uint32_t ConnectionId;
+
+struct ShardedServer {
+	//Framer is called (on the reactor thread) with a connection's recv_buffer and returns:
+	// - the size of the complete message at the front of the buffer, or
+	// - 0 if the message at the front isn't complete yet, or
+	// - Reject if the stream is garbage (the connection will be closed)
+	typedef std::function< size_t(RingBuffer const &buffer) > Framer;
+	static constexpr size_t Reject = size_t(-1);
+
+	ShardedServer(std::string const &port, uint32_t threads, Framer const &framer);
+	~ShardedServer(); //stops reactor threads
+	ShardedServer(ShardedServer const &) = delete;
+
+	typedef std::function< void(ConnectionId id, Connection::Event event, char const *data, size_t size) > EventHandler;
+	//poll() delivers connection events and (one call per message) framed messages:
+	// (will wait up to 'timeout' for the first event)
+	void poll(EventHandler const &on_event, double timeout = 0.0);
+
+	//queue data for a connection:
+	// ('messages' is the number of messages the data completes, for the connection's stats.messages_out;
+	//  pass 0 for all but the last piece of a message that is sent in several pieces)
+	// ('coalesce', if not zero, marks the data as (part of) a message that is superseded by the next
+	//  message with the same 'coalesce' key -- e.g., a state snapshot. While the connection is backed up
+	//  (see Connection::send_backed_up), such messages are held back and only the newest one per key is
+	//  kept; it is queued once the connection drains.)
+	void send(ConnectionId id, void const *data, size_t size, uint32_t messages = 1, char coalesce = 0); //copies data
+	void send_shared(ConnectionId id, SharedPayload const &payload, size_t begin, size_t end, uint32_t messages = 1, char coalesce = 0); //references payload
+	void send_shared(ConnectionId id, SharedPayload const &payload) {
+		send_shared(id, payload, 0, payload->size());
+	}
+	//close a connection (an OnClose event will follow):
+	void close(ConnectionId id);
+
+	//stats for one shard's Server and its connections:
+	struct ShardStats {
+		PollStats poll;
+		std::vector< std::pair< ConnectionId, Connection::Stats > > connections;
+	};
+	//get stats for every shard:
+	// (reactor threads publish a copy every StatsInterval seconds, so these may be a little old)
+	void collect_stats(std::vector< ShardStats > *stats);
+	static constexpr double StatsInterval = 0.25;
+
+	//internals:
+	//message from reactor to game thread:
+	struct Inbound {
+		ConnectionId id = 0;
+		Connection::Event event = Connection::OnOpen;
+		std::vector< char > data; //message bytes (OnRecv only)
+	};
+	//request from game thread to reactor:
+	struct Outbound {
+		enum Kind : uint8_t { Send, SendShared, Close } kind = Send;
+		uint8_t messages = 0; //(Send, SendShared) number of messages completed
+		char coalesce = 0; //(Send, SendShared) key of the superseding message this is part of (or 0)
+		ConnectionId id = 0;
+		//Send: small messages are stored inline, larger ones in 'data':
+		static constexpr size_t InlineSize = 32;
+		uint8_t inline_size = 0;
+		char inline_data[InlineSize];
+		std::vector< char > data;
+		//SendShared:
+		SharedPayload payload;
+		size_t begin = 0, end = 0;
+	};
+
+	struct Shard {
+		Shard(std::string const &port, bool reuse_port, uint32_t index, uint32_t count);
+		Server server;
+		uint32_t index;
+		uint32_t count; //number of shards
+		std::vector< char > message; //scratch space for framed messages
+
+		//superseding messages (see send()) to a connection, per coalesce key:
+		struct Held {
+			char coalesce = 0;
+			std::vector< Outbound > pieces; //newest complete message, held back while the connection is backed up
+			enum : uint8_t {
+				Between, //no message in progress
+				Direct, //pieces of the current message are being queued as they arrive
+				Holding, //pieces of the current message are being collected in 'pieces'
+			} state = Between;
+		};
+		size_t held_messages = 0; //number of Held with non-empty 'pieces'
+
+		//open connections, with their state:
+		struct Open {
+			Connection *connection = nullptr; //(whose 'tag' is the handle here)
+			std::vector< Held > held;
+		};
+		SlotMap< Open > open;
+		//convert between handles in 'open' and ConnectionIds:
+		ConnectionId to_id(SlotMap< Open >::Handle handle) const;
+		SlotMap< Open >::Handle to_handle(ConnectionId id) const;
+
+		//stats, as last copied out by publish_stats():
+		std::mutex stats_mutex; //(only contended when the game thread collects stats)
+		ShardStats published_stats;
+		std::chrono::steady_clock::time_point published_at;
+
+		SPSCQueue< Inbound > inbound; //reactor -> game thread
+		SPSCQueue< Outbound > outbound; //game thread -> reactor
+		std::thread thread;
+		bool can_wake = false; //server.wake() works (see Server::enable_wake()), so the reactor can sleep in poll()
+		std::atomic< bool > sleeping{false}; //reactor is (about to be) waiting in poll() with a long timeout
+
+		//run one Server::poll(), passing events + framed messages to 'deliver':
+		void poll(Framer const &framer, EventHandler const &deliver, double timeout);
+		//act on a request from the game thread:
+		void apply(Outbound &&out);
+		//queue (Send or SendShared) data on a connection:
+		void queue(Connection *c, Outbound &&out);
+		//queue held messages for connections that are no longer backed up:
+		void release_held();
+		//forget about a closed connection:
+		void forget(Connection *c);
+		//copy current stats into published_stats:
+		void publish_stats();
+	};
+	std::vector< std::unique_ptr< Shard > > shards;
+	Framer framer;
+	bool threaded = false;
+	std::vector< ConnectionId > pending_closes; //(inline mode) closes requested by the game, reported on next poll()
+	std::deque< Inbound > backlog; //(threaded mode) events push() took off inbound queues, delivered first by next poll()
+	std::atomic< bool > stop{false};
+
+	Shard &shard_for(ConnectionId id);
+	void push(Outbound &&out);
+	void wake(Shard &shard); //wake the shard's reactor if it is sleeping
+};
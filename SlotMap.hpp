@@ -0,0 +1,147 @@
+#pragma once
+
+/*
+ * SlotMap stores values contiguously and names them by generational handles.
+ *
+ * A handle is a slot number (low SlotBits bits) plus the slot's generation
+ *  (high bits), which changes every time the slot is reused; so lookups are
+ *  an array index and a compare, and a handle kept around after its value
+ *  was erased (e.g., a departed connection) finds nothing rather than
+ *  whatever took its slot. (The generation is 8 bits, so a stale handle is
+ *  only recognized until its slot has been reused 255 more times.)
+ *
+ * Values live in a dense array, so iterating over them is a plain loop over
+ *  a vector; erasing moves the last value into the hole (so value order
+ *  changes, and pointers to values are only good until the next insert or
+ *  erase -- hold on to handles instead).
+ *
+ * Handles are normally assigned by insert(). insert_at() instead takes a
+ *  handle assigned elsewhere (e.g., by another SlotMap, on another thread),
+ *  so state can be kept under the same names; don't mix the two in one map.
+ *  Handle 0 is never used.
+ *
+ * For example:
+
+SlotMap< Player > players;
+SlotMap< Player >::Handle h = players.insert(Player());
+if (Player *player = players.find(h)) {
+	//...
+}
+for (Player &player : players) {
+	//...
+}
+players.erase(h);
+
+ */
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+#include <cassert>
+
+template< typename T >
+struct SlotMap {
+	typedef uint32_t Handle;
+	static constexpr uint32_t SlotBits = 24;
+	static constexpr uint32_t SlotMask = (1u << SlotBits) - 1;
+	static constexpr uint32_t MaxSlots = 1u << SlotBits;
+
+	static uint32_t slot_of(Handle handle) { return handle & SlotMask; }
+	static uint32_t generation_of(Handle handle) { return handle >> SlotBits; }
+	static Handle make_handle(uint32_t slot, uint32_t generation) { return (generation << SlotBits) | slot; }
+
+	//add 'value' in a free slot, returning its handle:
+	Handle insert(T &&value) {
+		assert(!external);
+		uint32_t slot;
+		if (!free_slots.empty()) {
+			slot = free_slots.back();
+			free_slots.pop_back();
+		} else {
+			assert(slot_handles.size() < MaxSlots);
+			slot = uint32_t(slot_handles.size());
+			slot_handles.emplace_back(make_handle(slot, 0));
+			slot_values.emplace_back(Free);
+		}
+		//next generation (skipping 0, so no handle is 0):
+		uint32_t generation = (generation_of(slot_handles[slot]) + 1) & 0xff;
+		if (generation == 0) generation = 1;
+		Handle handle = make_handle(slot, generation);
+		place(handle, std::move(value));
+		return handle;
+	}
+
+	//add 'value' under 'handle', which was assigned elsewhere (and isn't in this map):
+	T &insert_at(Handle handle, T &&value) {
+		assert(handle != 0);
+		assert(external || slot_handles.empty());
+		external = true;
+		uint32_t slot = slot_of(handle);
+		if (slot >= slot_handles.size()) {
+			slot_handles.resize(slot + 1, 0);
+			slot_values.resize(slot + 1, Free);
+		}
+		assert(slot_values[slot] == Free);
+		place(handle, std::move(value));
+		return values.back();
+	}
+
+	//the value named by 'handle', or nullptr if it was erased (or never existed):
+	T *find(Handle handle) {
+		uint32_t slot = slot_of(handle);
+		if (slot >= slot_handles.size() || slot_handles[slot] != handle || slot_values[slot] == Free) return nullptr;
+		return &values[slot_values[slot]];
+	}
+	T const *find(Handle handle) const {
+		return const_cast< SlotMap * >(this)->find(handle);
+	}
+
+	//remove the value named by 'handle' (returns false if there isn't one):
+	bool erase(Handle handle) {
+		if (!find(handle)) return false;
+		uint32_t slot = slot_of(handle);
+		uint32_t index = slot_values[slot];
+		uint32_t last = uint32_t(values.size()) - 1;
+		if (index != last) {
+			values[index] = std::move(values[last]);
+			value_slots[index] = value_slots[last];
+			slot_values[value_slots[index]] = index;
+		}
+		values.pop_back();
+		value_slots.pop_back();
+		slot_values[slot] = Free;
+		if (!external) free_slots.emplace_back(slot); //(slot_handles[slot] keeps the old generation, so insert() can bump it)
+		return true;
+	}
+
+	//the handle of values[index]:
+	Handle handle_at(size_t index) const {
+		return slot_handles[value_slots[index]];
+	}
+
+	size_t size() const { return values.size(); }
+	bool empty() const { return values.empty(); }
+
+	typename std::vector< T >::iterator begin() { return values.begin(); }
+	typename std::vector< T >::iterator end() { return values.end(); }
+	typename std::vector< T >::const_iterator begin() const { return values.begin(); }
+	typename std::vector< T >::const_iterator end() const { return values.end(); }
+
+	//internals:
+	static constexpr uint32_t Free = uint32_t(-1);
+	std::vector< T > values; //dense
+	std::vector< uint32_t > value_slots; //slot of each value
+	std::vector< Handle > slot_handles; //handle of the value in each slot (or of the last one, if free)
+	std::vector< uint32_t > slot_values; //index in 'values' of each slot's value (or Free)
+	std::vector< uint32_t > free_slots; //(most recently freed last)
+	bool external = false; //handles come from insert_at()
+
+	void place(Handle handle, T &&value) {
+		uint32_t slot = slot_of(handle);
+		slot_handles[slot] = handle;
+		slot_values[slot] = uint32_t(values.size());
+		values.emplace_back(std::move(value));
+		value_slots.emplace_back(slot);
+	}
+};
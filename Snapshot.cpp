@@ -0,0 +1,161 @@
+#include "Snapshot.hpp"
+
+#include "Protocol.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cassert>
+#include <cstring>
+
+static void append_varint(std::vector< char > *out, uint32_t value) {
+	char bytes[5];
+	out->insert(out->end(), bytes, bytes + encode_varint(bytes, value));
+}
+
+void SnapshotDelta::encode(Snapshot const *baseline_, Snapshot const &current, PositionFormat const &format) {
+	assert(records && "encode() writes into an existing buffer");
+	sequence = current.sequence;
+	baseline = (baseline_ ? baseline_->sequence : 0);
+	removed.clear();
+	ids.clear();
+	offsets.clear();
+	records->clear();
+
+	//walk both (id-sorted) player lists together:
+	static std::vector< Snapshot::Player > const empty;
+	std::vector< Snapshot::Player > const &before = (baseline_ ? baseline_->players : empty);
+	auto b = before.begin();
+	for (auto const &player : current.players) {
+		while (b != before.end() && b->id < player.id) {
+			removed.emplace_back(b->id);
+			++b;
+		}
+		char position[PositionFormat::MaxSize];
+		format.encode(player.position, position);
+		if (b != before.end() && b->id == player.id) {
+			//(compares encoded positions, so moves too small to show up -- and NaNs -- aren't resent)
+			char before_position[PositionFormat::MaxSize];
+			format.encode(b->position, before_position);
+			++b;
+			if (std::memcmp(before_position, position, format.size()) == 0) continue;
+		}
+
+		ids.emplace_back(player.id);
+		offsets.emplace_back(records->size());
+		append_varint(records.get(), player.id);
+		records->insert(records->end(), position, position + format.size());
+	}
+	while (b != before.end()) {
+		removed.emplace_back(b->id);
+		++b;
+	}
+	offsets.emplace_back(records->size());
+}
+
+void SnapshotDelta::message_header(uint32_t self, std::vector< char > *header, size_t *skip_begin, size_t *skip_end) const {
+	assert(header && skip_begin && skip_end);
+	assert(offsets.size() == ids.size() + 1 && "encode() first");
+
+	//leave out the client's own record, if it changed:
+	uint32_t changed = uint32_t(ids.size());
+	*skip_begin = *skip_end = records->size();
+	auto f = std::lower_bound(ids.begin(), ids.end(), self);
+	if (f != ids.end() && *f == self) {
+		*skip_begin = offsets[f - ids.begin()];
+		*skip_end = offsets[f - ids.begin() + 1];
+		changed -= 1;
+	}
+
+	//fields before the records (written after the message header, once its size is known):
+	char fields[5 * 4];
+	size_t fields_size = 0;
+	fields_size += encode_varint(fields + fields_size, sequence);
+	fields_size += encode_varint(fields + fields_size, baseline);
+	fields_size += encode_varint(fields + fields_size, uint32_t(removed.size()));
+	size_t removed_size = 0;
+	for (uint32_t id : removed) {
+		removed_size += varint_size(id);
+	}
+	size_t changed_size = varint_size(changed);
+
+	size_t payload_size = fields_size + removed_size + changed_size + records->size() - (*skip_end - *skip_begin);
+	header->resize(MaxMessageHeaderSize);
+	header->resize(encode_message_header(header->data(), ServerSnapshot, uint32_t(payload_size)));
+	header->insert(header->end(), fields, fields + fields_size);
+	for (uint32_t id : removed) {
+		append_varint(header, id);
+	}
+	append_varint(header, changed);
+}
+
+//------------------------------------
+
+Snapshot const &SnapshotReceiver::receive(MessageReader &message) {
+	uint32_t sequence = 0;
+	uint32_t baseline = 0;
+	message.read_varint(&sequence);
+	message.read_varint(&baseline);
+	if (message.failed || sequence == 0) {
+		throw std::runtime_error("Server sent a snapshot without a sequence number.");
+	}
+
+	Snapshot const *before = nullptr;
+	if (baseline != 0) {
+		before = &history[baseline % SnapshotHistory];
+		if (before->sequence != baseline || baseline % SnapshotHistory == sequence % SnapshotHistory) {
+			throw std::runtime_error("Server sent a snapshot relative to snapshot " + std::to_string(baseline) + ", which this client doesn't have.");
+		}
+	}
+	Snapshot &current = history[sequence % SnapshotHistory];
+	current.sequence = 0; //(until it's decoded)
+	current.players.clear();
+
+	uint32_t removed_count = 0;
+	message.read_varint(&removed_count);
+	removed.clear();
+	for (uint32_t i = 0; i < removed_count && !message.failed; ++i) {
+		uint32_t id = 0;
+		message.read_varint(&id);
+		if (!removed.empty() && id <= removed.back()) {
+			throw std::runtime_error("Server sent a snapshot with unsorted removals.");
+		}
+		removed.emplace_back(id);
+	}
+
+	//copy players from the baseline (unless removed) with ids below 'id':
+	static std::vector< Snapshot::Player > const empty;
+	std::vector< Snapshot::Player > const &players = (before ? before->players : empty);
+	auto b = players.begin();
+	auto r = removed.begin();
+	auto copy_until = [&](uint64_t id) {
+		for (; b != players.end() && b->id < id; ++b) {
+			while (r != removed.end() && *r < b->id) ++r;
+			if (r != removed.end() && *r == b->id) continue;
+			current.players.emplace_back(*b);
+		}
+	};
+
+	uint32_t changed_count = 0;
+	message.read_varint(&changed_count);
+	for (uint32_t i = 0; i < changed_count && !message.failed; ++i) {
+		uint32_t id = 0;
+		message.read_varint(&id);
+		if (!current.players.empty() && id <= current.players.back().id) {
+			throw std::runtime_error("Server sent a snapshot with unsorted records.");
+		}
+		copy_until(id);
+		if (b != players.end() && b->id == id) ++b; //(replaced)
+		current.players.emplace_back();
+		Snapshot::Player &player = current.players.back();
+		player.id = id;
+		char position[PositionFormat::MaxSize];
+		if (message.read(position, format.size())) player.position = format.decode(position);
+	}
+	copy_until(uint64_t(1) << 32); //(the rest)
+
+	if (message.failed) {
+		throw std::runtime_error("Server sent a truncated snapshot.");
+	}
+	current.sequence = sequence;
+	return current;
+}
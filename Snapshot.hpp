@@ -0,0 +1,80 @@
+#pragma once
+
+/*
+ * Snapshots of the players, as sent by the server every tick in 's' messages
+ *  (see Protocol.hpp).
+ *
+ * Snapshots are delta-encoded: each client acks ('a') the newest snapshot it
+ *  has received, and the server only sends what changed since that (baseline)
+ *  snapshot -- or everything, if there is no usable baseline (the client just
+ *  connected, or hasn't acked anything in SnapshotHistory ticks).
+ *
+ * Server and client both keep the last SnapshotHistory snapshots, so any
+ *  baseline the server picks is still around on the client to decode against.
+ *
+ * Server side:
+ *  each client gets its own snapshots (its "view": only the other players
+ *  near it; see server.cpp), so SnapshotDelta::encode() diffs the client's
+ *  current view against the one it acked, and message_header() writes the
+ *  start of the message. (message_header() can also leave out the client's
+ *  own record, for snapshots that contain it.)
+ * Client side:
+ *  SnapshotReceiver::receive() rebuilds the full snapshot from an 's' message.
+ */
+
+#include "Message.hpp"
+#include "PositionFormat.hpp"
+
+#include <glm/glm.hpp>
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdint>
+
+//snapshots kept (by the server and by each client) as possible baselines:
+constexpr uint32_t SnapshotHistory = 32;
+
+struct Snapshot {
+	struct Player {
+		uint32_t id = 0; //(see Protocol.hpp; names go with 'j' messages, not snapshots)
+		glm::vec3 position = glm::vec3(0.0f);
+	};
+	uint32_t sequence = 0; //0 => not a snapshot (yet)
+	std::vector< Player > players; //sorted by id
+};
+
+//The changes from one snapshot to another:
+struct SnapshotDelta {
+	//diff 'current' against 'baseline' (nullptr => send everything), writing positions in 'format':
+	// ('records' must already point to a buffer, which is overwritten)
+	void encode(Snapshot const *baseline, Snapshot const &current, PositionFormat const &format);
+
+	//get the start of the 's' message (message header through changed record count) for
+	// the client whose own record has id 'self'; the whole message is then
+	// 'header' + records[0, *skip_begin) + records[*skip_end, records->size()):
+	void message_header(uint32_t self, std::vector< char > *header, size_t *skip_begin, size_t *skip_end) const;
+
+	uint32_t sequence = 0;
+	uint32_t baseline = 0; //0 => full snapshot
+	std::vector< uint32_t > removed; //ids in baseline but not in current (sorted)
+	std::vector< uint32_t > ids; //ids of changed or added records (sorted)
+	std::vector< size_t > offsets; //record i is [offsets[i], offsets[i+1]) in 'records'
+	std::shared_ptr< std::vector< char > > records;
+};
+
+//Client-side decoding of 's' messages:
+struct SnapshotReceiver {
+	SnapshotReceiver() : history(SnapshotHistory) { }
+
+	//read the payload of an 's' message; returns the (full) snapshot it describes:
+	// throws if the message is garbage or its baseline is not in 'history'
+	Snapshot const &receive(MessageReader &message);
+
+	//how positions are encoded (from the server's 'f' message):
+	PositionFormat format;
+
+	//internals:
+	std::vector< Snapshot > history; //recently received snapshots, indexed by sequence % SnapshotHistory
+	std::vector< uint32_t > removed; //(scratch space for receive())
+};
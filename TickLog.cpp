@@ -0,0 +1,299 @@
+#include "TickLog.hpp"
+
+#ifdef _WIN32
+#define _CRT_SECURE_NO_WARNINGS 1 //so we can use fopen()
+#include <cstdio>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+#include <cstring>
+#include <cerrno>
+
+namespace {
+	char const Magic[8] = {'T','I','C','K','L','O','G','3'};
+	constexpr size_t GrowSize = size_t(64) << 20;
+
+	//header layout:
+	constexpr size_t EndOffset = 8; //uint64_t
+	constexpr size_t BitsOffset = 16; //uint8_t
+	constexpr size_t MinOffset = 20; //glm::vec3
+	constexpr size_t MaxOffset = 32; //glm::vec3
+	constexpr size_t NearOffset = 44; //float
+	constexpr size_t FarOffset = 48; //float
+	constexpr size_t IntervalOffset = 52; //uint32_t
+	constexpr size_t RateOffset = 56; //double
+	static_assert(RateOffset + sizeof(double) <= TickLog::HeaderSize, "header fits");
+
+	template< typename T >
+	void put(char *at, T const &value) {
+		std::memcpy(at, &value, sizeof(T));
+	}
+	template< typename T >
+	T get(char const *at) {
+		T value;
+		std::memcpy(&value, at, sizeof(T));
+		return value;
+	}
+}
+
+//------------------------------------------------
+
+void TickLog::write_snapshot(uint32_t room, Snapshot const &snapshot, std::vector< char > *out_) {
+	auto &out = *out_;
+	auto append = [&out](void const *data, size_t size) {
+		out.insert(out.end(), reinterpret_cast< char const * >(data), reinterpret_cast< char const * >(data) + size);
+	};
+	uint32_t count = uint32_t(snapshot.players.size());
+	append(&room, sizeof(room));
+	append(&count, sizeof(count));
+	for (auto const &player : snapshot.players) {
+		append(&player.id, sizeof(player.id));
+		append(&player.position, sizeof(player.position));
+	}
+}
+
+bool TickLog::read_snapshots(char const *data, size_t size, std::vector< RoomSnapshot > *snapshots) {
+	char const *end = data + size;
+	if (size_t(end - data) < 4) return false;
+	uint32_t rooms = get< uint32_t >(data);
+	data += 4;
+	if (rooms > size / 8) return false; //(each room takes at least 8 bytes)
+	snapshots->resize(rooms);
+	for (auto &room : *snapshots) {
+		if (size_t(end - data) < 8) return false;
+		room.room = get< uint32_t >(data);
+		uint32_t count = get< uint32_t >(data + 4);
+		data += 8;
+		constexpr size_t PlayerSize = 4 + sizeof(glm::vec3);
+		if (size_t(end - data) / PlayerSize < count) return false;
+		room.snapshot.players.resize(count);
+		for (auto &player : room.snapshot.players) {
+			player.id = get< uint32_t >(data);
+			player.position = get< glm::vec3 >(data + 4);
+			data += PlayerSize;
+		}
+	}
+	return data == end;
+}
+
+//------------------------------------------------
+
+TickRecorder::TickRecorder(std::string const &path_, TickLog::Settings const &settings) : path(path_), start(std::chrono::steady_clock::now()) {
+	#ifdef _WIN32
+	//(no mmap; the log is kept in memory and written out by the destructor)
+	FILE *file = std::fopen(path.c_str(), "wb");
+	if (!file) throw std::runtime_error("Failed to create tick log '" + path + "'.");
+	std::fclose(file);
+	reserve(TickLog::HeaderSize);
+	#else
+	fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) throw std::system_error(errno, std::system_category(), "failed to create tick log '" + path + "'");
+	reserve(TickLog::HeaderSize);
+	#endif
+
+	std::memset(map, 0, TickLog::HeaderSize);
+	std::memcpy(map, Magic, sizeof(Magic));
+	PositionFormat const &format = settings.position_format;
+	put(map + BitsOffset, format.bits);
+	put(map + MinOffset, format.min);
+	put(map + MaxOffset, format.max);
+	put(map + NearOffset, settings.near_radius);
+	put(map + FarOffset, settings.far_radius);
+	put(map + IntervalOffset, settings.far_interval);
+	put(map + RateOffset, settings.tick_rate);
+	used = TickLog::HeaderSize;
+	commit();
+}
+
+TickRecorder::~TickRecorder() {
+	commit();
+	#ifdef _WIN32
+	FILE *file = std::fopen(path.c_str(), "wb");
+	if (file) {
+		std::fwrite(map, 1, used, file);
+		std::fclose(file);
+	}
+	#else
+	if (map) munmap(map, capacity);
+	if (fd >= 0) {
+		if (ftruncate(fd, off_t(used)) != 0) { /* leaves the (unused) tail; readers ignore it */ }
+		::close(fd);
+	}
+	#endif
+}
+
+void TickRecorder::reserve(size_t size) {
+	if (used + size <= capacity) return;
+	size_t new_capacity = capacity + std::max(GrowSize, size);
+	#ifdef _WIN32
+	memory.resize(new_capacity);
+	map = memory.data();
+	#else
+	if (ftruncate(fd, off_t(new_capacity)) != 0) {
+		throw std::system_error(errno, std::system_category(), "failed to grow tick log '" + path + "'");
+	}
+	if (map) munmap(map, capacity);
+	void *mapped = mmap(nullptr, new_capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (mapped == MAP_FAILED) {
+		map = nullptr;
+		capacity = 0;
+		throw std::system_error(errno, std::system_category(), "failed to map tick log '" + path + "'");
+	}
+	map = static_cast< char * >(mapped);
+	#endif
+	capacity = new_capacity;
+}
+
+void TickRecorder::commit() {
+	if (map) put(map + EndOffset, uint64_t(used));
+}
+
+void TickRecorder::append(TickLog::RecordType type, char const *a, size_t a_size, char const *b, size_t b_size) {
+	size_t size = a_size + b_size;
+	reserve(TickLog::RecordHeaderSize + size);
+	uint64_t time_ns = uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - start).count());
+	char *at = map + used;
+	at[0] = char(type);
+	put(at + 1, uint32_t(size));
+	put(at + 5, time_ns);
+	at += TickLog::RecordHeaderSize;
+	if (a_size) std::memcpy(at, a, a_size);
+	if (b_size) std::memcpy(at + a_size, b, b_size);
+	used += TickLog::RecordHeaderSize + size;
+}
+
+void TickRecorder::open(uint32_t connection, uint32_t token, uint32_t room) {
+	char payload[12];
+	put(payload, connection);
+	put(payload + 4, token);
+	put(payload + 8, room);
+	append(TickLog::Open, payload, sizeof(payload));
+}
+
+void TickRecorder::close(uint32_t connection) {
+	append(TickLog::Close, reinterpret_cast< char const * >(&connection), sizeof(connection));
+}
+
+void TickRecorder::message(uint32_t connection, char const *data, size_t size) {
+	append(TickLog::Message, reinterpret_cast< char const * >(&connection), sizeof(connection), data, size);
+}
+
+void TickRecorder::datagram(char const *data, size_t size) {
+	append(TickLog::Datagram, data, size);
+}
+
+void TickRecorder::tick_begin() {
+	append(TickLog::TickBegin, nullptr, 0);
+}
+
+void TickRecorder::room_snapshot(uint32_t room, Snapshot const &snapshot) {
+	if (snapshot_count == 0) snapshots.assign(4, 0); //(room count goes here)
+	TickLog::write_snapshot(room, snapshot, &snapshots);
+	snapshot_count += 1;
+}
+
+void TickRecorder::tick_end() {
+	if (snapshot_count == 0) snapshots.assign(4, 0);
+	put(snapshots.data(), snapshot_count);
+	append(TickLog::TickEnd, snapshots.data(), snapshots.size());
+	snapshot_count = 0;
+	commit();
+}
+
+//------------------------------------------------
+
+TickLogReader::TickLogReader(std::string const &path) {
+	#ifdef _WIN32
+	FILE *file = std::fopen(path.c_str(), "rb");
+	if (!file) throw std::runtime_error("Failed to open tick log '" + path + "'.");
+	char buffer[4096];
+	size_t got;
+	while ((got = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		memory.insert(memory.end(), buffer, buffer + got);
+	}
+	std::fclose(file);
+	map = memory.data();
+	size = memory.size();
+	#else
+	fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) throw std::system_error(errno, std::system_category(), "failed to open tick log '" + path + "'");
+	struct stat info;
+	if (fstat(fd, &info) != 0) throw std::system_error(errno, std::system_category(), "failed to stat tick log '" + path + "'");
+	size = size_t(info.st_size);
+	if (size >= TickLog::HeaderSize) {
+		void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapped == MAP_FAILED) throw std::system_error(errno, std::system_category(), "failed to map tick log '" + path + "'");
+		map = static_cast< char const * >(mapped);
+		madvise(const_cast< char * >(map), size, MADV_SEQUENTIAL);
+	}
+	#endif
+
+	if (size < TickLog::HeaderSize || std::memcmp(map, Magic, sizeof(Magic)) != 0) {
+		throw std::runtime_error("'" + path + "' is not a tick log.");
+	}
+	end = size_t(get< uint64_t >(map + EndOffset));
+	if (end < TickLog::HeaderSize || end > size) {
+		throw std::runtime_error("Tick log '" + path + "' is truncated or corrupt.");
+	}
+
+	//(throws if the format is nonsense)
+	settings.position_format = PositionFormat(get< uint8_t >(map + BitsOffset), get< glm::vec3 >(map + MinOffset), get< glm::vec3 >(map + MaxOffset));
+	settings.near_radius = get< float >(map + NearOffset);
+	settings.far_radius = get< float >(map + FarOffset);
+	settings.far_interval = get< uint32_t >(map + IntervalOffset);
+	settings.tick_rate = get< double >(map + RateOffset);
+
+	at = TickLog::HeaderSize;
+}
+
+TickLogReader::~TickLogReader() {
+	#ifndef _WIN32
+	if (map) munmap(const_cast< char * >(map), size);
+	if (fd >= 0) ::close(fd);
+	#endif
+}
+
+bool TickLogReader::next(TickLog::Record *record) {
+	if (at == end) return false;
+	if (end - at < TickLog::RecordHeaderSize) throw std::runtime_error("Tick log has a truncated record.");
+	char const *header = map + at;
+	uint8_t type = uint8_t(header[0]);
+	size_t payload = get< uint32_t >(header + 1);
+	if (end - at - TickLog::RecordHeaderSize < payload) throw std::runtime_error("Tick log has a truncated record.");
+
+	record->type = TickLog::RecordType(type);
+	record->time_ns = get< uint64_t >(header + 5);
+	record->connection = 0;
+	record->token = 0;
+	record->room = 0;
+	record->data = header + TickLog::RecordHeaderSize;
+	record->size = payload;
+
+	if (type == TickLog::Open) {
+		if (payload != 12) throw std::runtime_error("Tick log has a bad open record.");
+		record->connection = get< uint32_t >(record->data);
+		record->token = get< uint32_t >(record->data + 4);
+		record->room = get< uint32_t >(record->data + 8);
+		record->size = 0;
+	} else if (type == TickLog::Close || type == TickLog::Message) {
+		if (payload < 4 || (type == TickLog::Close && payload != 4)) throw std::runtime_error("Tick log has a bad connection record.");
+		record->connection = get< uint32_t >(record->data);
+		record->data += 4;
+		record->size -= 4;
+	} else if (type == TickLog::Datagram || type == TickLog::TickBegin || type == TickLog::TickEnd) {
+		//(payload is the data)
+	} else {
+		throw std::runtime_error("Tick log has a record of unknown type " + std::to_string(int(type)) + ".");
+	}
+
+	at += TickLog::RecordHeaderSize + payload;
+	return true;
+}
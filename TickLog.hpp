@@ -0,0 +1,154 @@
+#pragma once
+
+/*
+ * TickLog records everything that goes into the server's game loop, so that
+ *  the loop can be re-run offline (`server --replay <log>`): as a
+ *  reproducible CPU benchmark, or to look into what happened in a session.
+ *
+ * The log is an append-only file of records, written through a memory
+ *  mapping (so recording costs a memcpy per record; the file is grown, and
+ *  remapped, 64 MiB at a time; on Windows it is just buffered in memory):
+ *  [header] - TickLog::HeaderSize bytes: magic, the size of the valid part of
+ *             the file, and the settings that affect the game loop
+ *  records, each:
+ *   [type] - uint8_t (TickLog::RecordType)
+ *   [size] - uint32_t, of the payload
+ *   [time] - uint64_t, nanoseconds since recording started (when the server got it)
+ *   [payload] - 'size' bytes:
+ *    Open: [connection] uint32_t, [datagram token] uint32_t, [room] uint32_t (the room it was put in)
+ *    Close: [connection] uint32_t
+ *    Message: [connection] uint32_t, then the whole (framed) client message
+ *    Datagram: the whole datagram
+ *    TickBegin: (nothing)
+ *    TickEnd: [count] uint32_t, then that many rooms' snapshots of their players
+ *             (see write_snapshot(); only rooms with players are ticked, so only they are listed)
+ *
+ * The header's size is only updated at the end of each tick, so a log cut
+ *  short (e.g., by killing the server, which leaves the file at its mapped
+ *  size) still replays up to the last complete tick.
+ *
+ * For example:
+
+TickRecorder recorder("session.tick", settings);
+recorder.open(connection, token);
+recorder.message(connection, data, size);
+recorder.tick_begin();
+recorder.room_snapshot(room, snapshot);
+recorder.tick_end();
+
+TickLogReader reader("session.tick");
+TickLog::Record record;
+while (reader.next(&record)) {
+	//...
+}
+
+ */
+
+#include "PositionFormat.hpp"
+#include "Snapshot.hpp"
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace TickLog {
+	constexpr size_t HeaderSize = 64;
+	constexpr size_t RecordHeaderSize = 1 + 4 + 8;
+
+	enum RecordType : uint8_t {
+		Open = 1,
+		Close = 2,
+		Message = 3,
+		Datagram = 4,
+		TickBegin = 5,
+		TickEnd = 6,
+	};
+
+	//the server settings that replays need to match the recording:
+	struct Settings {
+		PositionFormat position_format;
+		float near_radius = 0.0f;
+		float far_radius = 0.0f;
+		uint32_t far_interval = 1;
+		double tick_rate = 0.0;
+	};
+
+	struct Record {
+		RecordType type = Open;
+		uint64_t time_ns = 0;
+		uint32_t connection = 0; //(Open, Close, Message)
+		uint32_t token = 0; //(Open)
+		uint32_t room = 0; //(Open)
+		char const *data = nullptr; //(Message, Datagram, TickEnd) points into the log
+		size_t size = 0;
+	};
+
+	//one room's snapshot in a TickEnd payload:
+	struct RoomSnapshot {
+		uint32_t room = 0;
+		Snapshot snapshot;
+	};
+	//append a room's snapshot to '*out' (positions are stored as raw glm::vec3s, so they compare exactly):
+	void write_snapshot(uint32_t room, Snapshot const &snapshot, std::vector< char > *out);
+	//TickEnd payload -> every room's snapshot (reuses the storage in '*snapshots'); returns false if garbled:
+	bool read_snapshots(char const *data, size_t size, std::vector< RoomSnapshot > *snapshots);
+}
+
+//Appends to a tick log:
+struct TickRecorder {
+	//create (or overwrite) the log at 'path'; throws on failure:
+	TickRecorder(std::string const &path, TickLog::Settings const &settings);
+	~TickRecorder(); //(trims the file to what was written)
+	TickRecorder(TickRecorder const &) = delete;
+
+	void open(uint32_t connection, uint32_t token, uint32_t room);
+	void close(uint32_t connection);
+	void message(uint32_t connection, char const *data, size_t size);
+	void datagram(char const *data, size_t size);
+	void tick_begin();
+	void room_snapshot(uint32_t room, Snapshot const &snapshot); //(call for each ticked room, before tick_end())
+	void tick_end(); //(also marks everything so far as valid)
+
+	//internals:
+	void append(TickLog::RecordType type, char const *a, size_t a_size, char const *b = nullptr, size_t b_size = 0);
+	void reserve(size_t size); //make sure 'size' more bytes fit in the mapping
+	void commit(); //store 'used' in the header
+
+	std::string path;
+	std::chrono::steady_clock::time_point start;
+	int fd = -1;
+	char *map = nullptr;
+	size_t capacity = 0; //size of file (and mapping)
+	size_t used = 0; //bytes written
+	std::vector< char > snapshots; //this tick's TickEnd payload, so far
+	uint32_t snapshot_count = 0; //rooms in it
+	#ifdef _WIN32
+	std::vector< char > memory; //(no mmap on Windows: the log is kept here until the destructor writes it out)
+	#endif
+};
+
+//Reads a tick log:
+struct TickLogReader {
+	//map the log at 'path'; throws if it isn't a tick log:
+	TickLogReader(std::string const &path);
+	~TickLogReader();
+	TickLogReader(TickLogReader const &) = delete;
+
+	TickLog::Settings settings;
+
+	//read the next record; returns false at the end of the (valid part of the) log:
+	// throws if a record is garbage
+	bool next(TickLog::Record *record);
+
+	//internals:
+	int fd = -1;
+	char const *map = nullptr;
+	size_t size = 0; //of the mapping
+	size_t end = 0; //end of valid records
+	size_t at = 0; //next record
+	#ifdef _WIN32
+	std::vector< char > memory; //(the whole file, read in)
+	#endif
+};
@@ -0,0 +1,75 @@
+#include "TickScheduler.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+//poll_timeout() ends this long before the next tick is due, since socket waits round up to whole milliseconds:
+static constexpr double PollSlack = 0.002;
+
+TickScheduler::TickScheduler(double rate, Policy policy_, uint32_t max_catch_up_) : policy(policy_), max_catch_up(max_catch_up_) {
+	if (!(rate > 0.0)) {
+		throw std::runtime_error("Tick rate must be positive.");
+	}
+	period = std::chrono::duration_cast< Clock::duration >(std::chrono::duration< double >(1.0 / rate));
+	if (period <= Clock::duration::zero()) period = Clock::duration(1);
+	due = Clock::now() + period;
+}
+
+bool TickScheduler::parse_policy(std::string const &name, Policy *policy) {
+	if (name == "catch-up") *policy = CatchUp;
+	else if (name == "skip") *policy = Skip;
+	else return false;
+	return true;
+}
+
+double TickScheduler::poll_timeout() const {
+	double remain = std::chrono::duration< double >(due - Clock::now()).count();
+	return std::max(0.0, remain - PollSlack);
+}
+
+void TickScheduler::begin_tick() {
+	if (free_running) due = Clock::now();
+	std::this_thread::sleep_until(due);
+	Clock::time_point now = Clock::now();
+
+	Clock::duration late = now - due;
+	stats.start_late_us.add(uint64_t(std::chrono::duration_cast< std::chrono::microseconds >(late).count()));
+
+	//whole periods this tick is late by => ticks that were missed:
+	uint64_t behind = uint64_t(late / period);
+	uint64_t skip = 0;
+	if (policy == Skip) {
+		skip = behind;
+	} else if (behind > max_catch_up) {
+		skip = behind - max_catch_up;
+	}
+	stats.skipped += skip;
+	if (behind > skip) stats.caught_up += 1;
+
+	due += period * int64_t(skip + 1);
+	tick_start = phase_start = now;
+}
+
+char const *TickScheduler::phase_name(Phase phase) {
+	if (phase == IO) return "io";
+	else if (phase == Simulate) return "simulate";
+	else if (phase == Serialize) return "serialize";
+	else if (phase == Flush) return "flush";
+	else return "unknown";
+}
+
+void TickScheduler::end_phase(Phase phase) {
+	Clock::time_point now = Clock::now();
+	if (phase < PhaseCount) {
+		stats.phase_us[phase].add(uint64_t(std::chrono::duration_cast< std::chrono::microseconds >(now - phase_start).count()));
+	}
+	phase_start = now;
+}
+
+void TickScheduler::end_tick() {
+	Clock::time_point now = Clock::now();
+	stats.ticks += 1;
+	stats.work_us.add(uint64_t(std::chrono::duration_cast< std::chrono::microseconds >(now - tick_start).count()));
+	if (now > due) stats.overruns += 1;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+/*
+ * TickScheduler decides when the server's fixed-rate ticks start, and keeps
+ *  track of how well it is keeping up.
+ *
+ * Tick i is due at start + i * period. Between ticks the server polls its
+ *  sockets with poll_timeout(), which ends a little before the next tick is
+ *  due (socket waits only have millisecond resolution); begin_tick() then
+ *  sleeps the rest of the way, so ticks start within (about) the sleep
+ *  precision of their due time.
+ *
+ * When ticks fall behind by one or more whole periods, the policy decides
+ *  what happens to the missed ticks:
+ *  - CatchUp runs them back-to-back (up to max_catch_up of them; any more are
+ *    skipped), so the tick count keeps matching wall-clock time.
+ *  - Skip drops them, and the next tick starts at the next due time.
+ *
+ * Each tick's work is split into phases (end_phase() charges the time since
+ *  the previous phase ended), which are timed separately.
+ *
+ * For example:
+
+TickScheduler scheduler(30.0, TickScheduler::CatchUp);
+while (true) {
+	do {
+		server.poll(..., scheduler.poll_timeout());
+	} while (scheduler.poll_timeout() > 0.0);
+	scheduler.begin_tick();
+	//...read input...
+	scheduler.end_phase(TickScheduler::IO);
+	//...
+	scheduler.end_tick();
+}
+
+ */
+
+#include "Histogram.hpp"
+
+#include <chrono>
+#include <string>
+#include <cstdint>
+
+struct TickScheduler {
+	typedef std::chrono::steady_clock Clock;
+
+	enum Policy {
+		CatchUp, //run missed ticks late (up to max_catch_up of them)
+		Skip, //drop missed ticks
+	};
+	//'rate' ticks per second (must be positive):
+	TickScheduler(double rate, Policy policy, uint32_t max_catch_up = 4);
+
+	//parse "catch-up" or "skip" (returns false for anything else):
+	static bool parse_policy(std::string const &name, Policy *policy);
+
+	//how long the caller can wait for other things (e.g., socket events) before calling begin_tick():
+	// (0 => call begin_tick() now)
+	double poll_timeout() const;
+
+	//wait for the next tick to be due (if it isn't already) and start it:
+	void begin_tick();
+
+	//phases of a tick's work:
+	enum Phase : uint32_t {
+		IO, //reading input
+		Simulate, //updating game state
+		Serialize, //building messages
+		Flush, //handing messages to the network
+		PhaseCount
+	};
+	static char const *phase_name(Phase phase);
+	//charge the time since begin_tick() (or the last end_phase()) to 'phase':
+	void end_phase(Phase phase);
+
+	//finish the current tick:
+	void end_tick();
+
+	Clock::duration period;
+	Policy policy;
+	uint32_t max_catch_up;
+	bool free_running = false; //start each tick as soon as begin_tick() is called (e.g., when replaying a tick log; overruns still count ticks that took longer than a period)
+
+	struct Stats {
+		uint64_t ticks = 0;
+		uint64_t overruns = 0; //ticks whose work ran past the time the next tick was due
+		uint64_t caught_up = 0; //ticks started a whole period (or more) late
+		uint64_t skipped = 0; //ticks dropped
+		Histogram start_late_us; //how long after its due time each tick started
+		Histogram work_us; //time from begin_tick() to end_tick()
+		Histogram phase_us[PhaseCount];
+	} stats;
+
+	//internals:
+	Clock::time_point due; //when the next tick is due (during a tick: when the one after it is due)
+	Clock::time_point tick_start;
+	Clock::time_point phase_start;
+};
@@ -0,0 +1,67 @@
+#include "WorkerPool.hpp"
+
+WorkerPool::WorkerPool(uint32_t threads) {
+	for (uint32_t i = 0; i < threads; ++i) {
+		workers.emplace_back([this](){
+			uint64_t seen = 0;
+			while (true) {
+				{ //wait for a new batch:
+					std::unique_lock< std::mutex > lock(mutex);
+					wake.wait(lock, [&](){ return stop || batch != seen; });
+					if (stop) return;
+					seen = batch;
+				}
+				take_jobs();
+				{
+					std::lock_guard< std::mutex > lock(mutex);
+					busy -= 1;
+					if (busy == 0) done.notify_one();
+				}
+			}
+		});
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		stop = true;
+	}
+	wake.notify_all();
+	for (auto &worker : workers) {
+		worker.join();
+	}
+}
+
+void WorkerPool::take_jobs() {
+	uint32_t i;
+	while ((i = next.fetch_add(1, std::memory_order_relaxed)) < count) {
+		(*job)(i);
+	}
+}
+
+void WorkerPool::run(uint32_t count_, std::function< void(uint32_t) > const &job_) {
+	if (count_ == 0) return;
+	if (workers.empty() || count_ == 1) {
+		for (uint32_t i = 0; i < count_; ++i) job_(i);
+		return;
+	}
+
+	{ //start a batch:
+		std::lock_guard< std::mutex > lock(mutex);
+		job = &job_;
+		count = count_;
+		next.store(0, std::memory_order_relaxed);
+		busy = uint32_t(workers.size());
+		batch += 1;
+	}
+	wake.notify_all();
+
+	//help out:
+	take_jobs();
+
+	//wait for the workers to finish theirs (and to stop looking at 'job'):
+	std::unique_lock< std::mutex > lock(mutex);
+	done.wait(lock, [&](){ return busy == 0; });
+	job = nullptr;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+/*
+ * WorkerPool runs batches of independent jobs (e.g., ticking every Room) on a
+ *  fixed set of threads.
+ *
+ * run() hands out job indices one at a time (through an atomic counter) to
+ *  the workers and the calling thread, so a thread that finishes a cheap job
+ *  just takes the next one; handing out the expensive jobs first (as
+ *  server.cpp does, using each room's last tick time) keeps one long job
+ *  from being started last and holding up the batch.
+ * It returns once every job has finished, so anything the jobs wrote can be
+ *  read afterward without further synchronization.
+ *
+ * With threads == 0, run() just calls every job on the calling thread.
+ *
+ * For example:
+
+WorkerPool pool(4);
+pool.run(uint32_t(rooms.size()), [&](uint32_t i){
+	rooms[i]->serialize();
+});
+
+ */
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+struct WorkerPool {
+	WorkerPool(uint32_t threads);
+	~WorkerPool(); //stops the threads
+	WorkerPool(WorkerPool const &) = delete;
+
+	//call 'job(i)' for every i in [0, count) -- on the pool's threads and the calling thread -- and wait for all of them:
+	void run(uint32_t count, std::function< void(uint32_t) > const &job);
+
+	uint32_t threads() const { return uint32_t(workers.size()); }
+
+	//internals:
+	std::vector< std::thread > workers;
+	std::mutex mutex;
+	std::condition_variable wake; //(workers wait on this for a batch)
+	std::condition_variable done; //(run() waits on this for the workers to finish the batch)
+	uint64_t batch = 0; //incremented for every run()
+	uint32_t busy = 0; //workers still working on the current batch
+	bool stop = false;
+	std::function< void(uint32_t) > const *job = nullptr; //(current batch)
+	uint32_t count = 0;
+	std::atomic< uint32_t > next{0}; //next job index to hand out
+
+	void take_jobs(); //run jobs from the current batch until there are none left
+};
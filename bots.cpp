@@ -0,0 +1,509 @@
+
+//Headless load generator: runs many simulated players in one process to find
+// out how many a server can hold.
+//
+//Each bot connects like the real client, speaks the same protocol (see Protocol.hpp;
+// a 'c' message, then 'b' messages, plus position datagrams once the server sends a token (and only those once the
+// server acks them), snapshot acks, and pings;
+// positions in the format the server's 'f' message gives; compressed 'z' messages unless --no-compression),
+// and walks a random path on the game's WalkMesh (or, with --idle, stands still).
+//
+//Since every bot shares one clock, the bots can tell how old the positions in their
+// snapshots are: the first few bots ("observers") look up every position they receive
+// in a table of positions sent by all bots, and record:
+// - update round trip: from a bot sending a position to the position first coming back in a snapshot
+// - staleness: age of every (recognized) position in every snapshot
+//Every bot also measures its ping round trip and clock offset to the server (see ClockSync.hpp); since the
+// bots usually run on the same machine as the server, the offset should come out near zero.
+//If the server was started with --metrics-port, its tick-time distribution is fetched at the end.
+
+#include "Connection.hpp"
+#include "DatagramSocket.hpp"
+#include "Message.hpp"
+#include "Protocol.hpp"
+#include "Metrics.hpp"
+#include "Snapshot.hpp"
+#include "ClockSync.hpp"
+#include "WalkMesh.hpp"
+#include "data_path.hpp"
+
+#include <glm/glm.hpp>
+#include <glm/gtx/quaternion.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <memory>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <cstring>
+#include <cmath>
+
+#ifdef _WIN32
+extern "C" { uint32_t GetACP(); }
+#endif
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	{ //when compiled on windows, check that code page is forced to utf-8 (makes file loading/saving work right):
+		//see: https://docs.microsoft.com/en-us/windows/apps/design/globalizing/use-utf8-code-page
+		uint32_t code_page = GetACP();
+		if (code_page == 65001) {
+			std::cout << "Code page is properly set to UTF-8." << std::endl;
+		} else {
+			std::cout << "WARNING: code page is set to " << code_page << " instead of 65001 (UTF-8). Some file handling functions may fail." << std::endl;
+		}
+	}
+
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	//------------ argument parsing ------------
+
+	std::string host, port;
+	uint32_t count = 0;
+	double seconds = 30.0; //how long to measure
+	double warmup = 1.0; //run this long before measuring (while the bots connect and the server catches up)
+	double rate = 60.0; //bot "frames" per second (each frame: walk, send, receive)
+	uint32_t observers = 4; //bots that measure round trip / staleness
+	uint32_t idle = 0; //bots (the last ones) that stand still
+	bool compression = true; //ask the server for compressed messages
+	std::string server_metrics_port; //server's --metrics-port, to fetch its tick stats at the end
+	std::string report_json; //also append the final report (as JSON) to this file
+	{
+		std::vector< std::string > positional;
+		bool ok = true;
+		for (int argi = 1; argi < argc; ++argi) {
+			std::string arg = argv[argi];
+			bool has_value = (argi + 1 < argc);
+			if (arg == "--seconds" && has_value) {
+				seconds = std::stod(argv[++argi]);
+			} else if (arg == "--warmup" && has_value) {
+				warmup = std::stod(argv[++argi]);
+			} else if (arg == "--rate" && has_value) {
+				rate = std::stod(argv[++argi]);
+			} else if (arg == "--idle" && has_value) {
+				idle = uint32_t(std::stoul(argv[++argi]));
+			} else if (arg == "--observers" && has_value) {
+				observers = uint32_t(std::stoul(argv[++argi]));
+			} else if (arg == "--no-compression") {
+				compression = false;
+			} else if (arg == "--server-metrics-port" && has_value) {
+				server_metrics_port = argv[++argi];
+			} else if (arg == "--report-json" && has_value) {
+				report_json = argv[++argi];
+			} else if (arg.substr(0,2) != "--") {
+				positional.emplace_back(arg);
+			} else {
+				ok = false;
+			}
+		}
+		if (ok && positional.size() == 3) {
+			host = positional[0];
+			port = positional[1];
+			count = uint32_t(std::stoul(positional[2]));
+		}
+		if (!ok || count == 0 || !(rate > 0.0)) {
+			std::cerr << "Usage:\n\t./bots <host> <port> <count> [--seconds <s>] [--warmup <s>] [--rate <frames/s>] [--observers <n>] [--idle <n>] [--no-compression] [--server-metrics-port <port>] [--report-json <file>]" << std::endl;
+			return 1;
+		}
+	}
+
+	//------------ initialization ------------
+
+	WalkMeshes walkmeshes(data_path("twin-circles.w"));
+	WalkMesh const &walkmesh = walkmeshes.lookup("WalkMesh");
+
+	std::mt19937 mt(0x15466); //(fixed seed, so runs are comparable)
+
+	typedef std::chrono::steady_clock Clock;
+	auto after = [](double seconds) {
+		return std::chrono::duration_cast< Clock::duration >(std::chrono::duration< double >(seconds));
+	};
+
+	struct Bot {
+		std::unique_ptr< Client > client;
+		std::unique_ptr< DatagramSocket > datagrams;
+		bool has_position_format = false; //got the server's 'f' message (its contents are in snapshots.format)
+		uint32_t datagram_token = 0; //from the server's 'u' message
+		uint32_t datagram_sequence = 0;
+		bool datagrams_acked = false; //got a 'd' message in the last DatagramAckTimeout (so 'b' messages aren't needed)
+		Clock::time_point datagram_acked_at;
+
+		WalkPoint at;
+		glm::vec3 heading = glm::vec3(0.0f); //world-space walking direction (in the plane of the current triangle)
+		float turn_timer = 0.0f; //time until picking a new heading
+
+		SnapshotReceiver snapshots;
+		Clock::time_point last_snapshot;
+		ClockSync clock_sync;
+		bool connected = true;
+	};
+	std::vector< Bot > bots(count);
+
+	//pick a random (walkable) heading at a bot's location:
+	auto random_heading = [&](Bot &bot) {
+		std::uniform_real_distribution< float > angle(0.0f, 2.0f * float(M_PI));
+		glm::vec3 normal = walkmesh.to_world_triangle_normal(bot.at);
+		glm::vec3 tangent = glm::normalize(glm::cross(normal, std::abs(normal.z) < 0.9f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f)));
+		glm::vec3 bitangent = glm::cross(normal, tangent);
+		float a = angle(mt);
+		bot.heading = std::cos(a) * tangent + std::sin(a) * bitangent;
+		bot.turn_timer = std::uniform_real_distribution< float >(1.0f, 4.0f)(mt);
+	};
+
+	for (uint32_t i = 0; i < count; ++i) {
+		Bot &bot = bots[i];
+		bot.client = std::make_unique< Client >(host, port);
+		bot.datagrams = std::make_unique< DatagramSocket >(bot.client->connection);
+		{
+			MessageWriter message(bot.client->connection, ClientCapabilities, 1);
+			message.write(uint8_t(compression ? CapabilityCompression : 0));
+		}
+
+		//start at a random point on a random triangle:
+		std::uniform_int_distribution< size_t > triangle(0, walkmesh.triangles.size() - 1);
+		std::uniform_real_distribution< float > unit(0.0f, 1.0f);
+		float u = unit(mt), v = unit(mt);
+		if (u + v > 1.0f) {
+			u = 1.0f - u;
+			v = 1.0f - v;
+		}
+		bot.at = WalkPoint(walkmesh.triangles[triangle(mt)], glm::vec3(1.0f - u - v, u, v));
+		random_heading(bot);
+	}
+	std::cout << "[bots] connected " << count << " bots to " << host << ":" << port << "." << std::endl;
+
+	//positions sent by all bots, so observers can tell how old received positions are:
+	struct PositionKey {
+		uint32_t bits[3];
+		bool operator==(PositionKey const &o) const { return std::memcmp(bits, o.bits, sizeof(bits)) == 0; }
+	};
+	struct PositionKeyHash {
+		size_t operator()(PositionKey const &k) const {
+			return std::hash< uint64_t >()((uint64_t(k.bits[0]) << 32) ^ (uint64_t(k.bits[1]) << 16) ^ uint64_t(k.bits[2]));
+		}
+	};
+	struct Sent {
+		Clock::time_point time; //when this position was (last) sent
+		bool seen = false; //has an observer seen it yet?
+	};
+	std::unordered_map< PositionKey, Sent, PositionKeyHash > sent;
+	auto key_for = [](glm::vec3 const &position) {
+		static_assert(sizeof(PositionKey) == sizeof(glm::vec3), "key is the position's bits");
+		PositionKey key;
+		std::memcpy(key.bits, &position, sizeof(key.bits));
+		return key;
+	};
+
+	//stats:
+	Histogram update_rtt_us;
+	Histogram staleness_us;
+	Histogram snapshot_interval_us; //(as seen by observers)
+	Histogram frame_us; //time to do one frame of work for all bots
+	Histogram clock_offset_us; //size of each bot's clock offset estimate, after every pong
+	uint64_t bytes_received = 0;
+	uint64_t messages_received = 0;
+	uint64_t state_messages_sent = 0;
+	uint64_t datagrams_sent = 0;
+	uint64_t positions_unrecognized = 0; //positions observers couldn't find in 'sent'
+	uint64_t decompress_messages = 0;
+	uint64_t decompress_bytes_in = 0;
+	uint64_t decompress_bytes_out = 0;
+	uint64_t decompress_ns = 0;
+	std::vector< char > inflated; //(decompressed 'z' messages)
+
+	//------------ main loop ------------
+
+	float const frame = float(1.0 / rate);
+	constexpr float BotSpeed = 9.0f; //(same as PlayMode's PlayerSpeed)
+	constexpr double ReportInterval = 5.0;
+	constexpr double SentLifetime = 5.0; //forget sent positions after this many seconds
+
+	auto start = Clock::now();
+	auto next_frame = start;
+	auto next_report = start + after(ReportInterval);
+	auto next_prune = start + after(1.0);
+	uint64_t messages_at_report = 0;
+
+	while (Clock::now() - start < after(warmup + seconds)) {
+		auto frame_start = Clock::now();
+		bool measuring = (frame_start - start >= after(warmup));
+
+		for (uint32_t b = 0; b < count; ++b) {
+			Bot &bot = bots[b];
+			if (!bot.connected) continue;
+			bool observer = (b < observers);
+
+			if (b + idle < count) { //walk (as in PlayMode::update, but following 'heading'):
+				bot.turn_timer -= frame;
+				if (bot.turn_timer <= 0.0f) random_heading(bot);
+				glm::vec3 remain = bot.heading * BotSpeed * frame;
+				for (uint32_t iter = 0; iter < 10; ++iter) {
+					if (remain == glm::vec3(0.0f)) break;
+					WalkPoint end;
+					float time;
+					walkmesh.walk_in_triangle(bot.at, remain, &end, &time);
+					bot.at = end;
+					if (time == 1.0f) break;
+					remain *= (1.0f - time);
+					glm::quat rotation;
+					if (walkmesh.cross_edge(bot.at, &end, &rotation)) {
+						bot.at = end;
+						remain = rotation * remain;
+						bot.heading = rotation * bot.heading;
+					} else {
+						//hit the edge of the walkable area; turn around:
+						random_heading(bot);
+						break;
+					}
+				}
+			}
+			glm::vec3 position = walkmesh.to_world_point(bot.at);
+
+			if (bot.has_position_format) { //send position (as the real client does):
+				PositionFormat const &format = bot.snapshots.format;
+				Sent &s = sent[key_for(format.round_trip(position))]; //(as others will see it)
+				s.time = Clock::now();
+				s.seen = false;
+				if (bot.datagrams_acked && Clock::now() - bot.datagram_acked_at > after(DatagramAckTimeout)) {
+					bot.datagrams_acked = false;
+				}
+				if (!bot.datagrams_acked) {
+					MessageWriter message(bot.client->connection, ClientState, client_state_payload(format));
+					message.write(uint8_t(0)); //pies collected
+					message.write(uint8_t(0)); //has won
+					char encoded[PositionFormat::MaxSize];
+					format.encode(position, encoded);
+					message.write(encoded, format.size());
+					state_messages_sent += 1;
+				}
+				if (bot.datagram_token != 0) {
+					bot.datagram_sequence += 1;
+					char message[1 + 4 + 4 + PositionFormat::MaxSize];
+					message[0] = 'p';
+					for (uint32_t i = 0; i < 4; ++i) {
+						message[1 + i] = char(uint8_t(bot.datagram_token >> (24 - 8 * i)));
+						message[5 + i] = char(uint8_t(bot.datagram_sequence >> (24 - 8 * i)));
+					}
+					format.encode(position, message + 9);
+					bot.datagrams->send(message, 9 + format.size());
+					datagrams_sent += 1;
+				}
+			}
+
+			ClockSync::Ping ping;
+			if (bot.clock_sync.ping(monotonic_ns(), &ping)) {
+				MessageWriter message(bot.client->connection, ClientPing, ClientPingPayload);
+				message.write(ping.sent);
+				message.write(ping.echo);
+				message.write(ping.held);
+			}
+
+			//send/receive:
+			bot.client->poll([&](Connection *c, Connection::Event event){
+				if (event == Connection::OnClose) {
+					std::cerr << "[bots] bot " << b << " lost its connection." << std::endl;
+					bot.connected = false;
+					return;
+				}
+				if (event != Connection::OnRecv) return;
+				MessageHeader header;
+				while (true) {
+					MessageStatus status = peek_message(c->recv_buffer, &header, MaxServerPayload);
+					if (status == MessageIncomplete) break;
+					if (status == MessageMalformed) {
+						throw std::runtime_error("Server sent a malformed message.");
+					}
+					MessageReader message(c->recv_buffer, header);
+					if (header.type == CompressedMessage) {
+						auto before = Clock::now();
+						if (!decompress_message(message, &inflated, MaxMessageHeaderSize + MaxServerPayload)) {
+							throw std::runtime_error("Server sent a garbled compressed message.");
+						}
+						decompress_ns += uint64_t(std::chrono::duration_cast< std::chrono::nanoseconds >(Clock::now() - before).count());
+						decompress_messages += 1;
+						decompress_bytes_in += header.total_size();
+						decompress_bytes_out += inflated.size();
+						message = MessageReader(inflated.data(), inflated.size());
+						if (message.failed) {
+							throw std::runtime_error("Server sent a compressed message that isn't a single message.");
+						}
+					}
+					if (message.header.type == ServerPositionFormat) {
+						uint8_t bits = 0;
+						glm::vec3 min, max;
+						message.read(&bits);
+						message.read(&min);
+						message.read(&max);
+						bot.snapshots.format = PositionFormat(bits, min, max);
+						bot.has_position_format = true;
+					} else if (message.header.type == ServerDatagramToken) {
+						message.read(&bot.datagram_token);
+					} else if (message.header.type == ServerDatagramAck) {
+						bot.datagrams_acked = true;
+						bot.datagram_acked_at = Clock::now();
+					} else if (message.header.type == ServerPong) {
+						uint64_t ping_sent = 0, ping_received = 0, pong_sent = 0;
+						message.read(&ping_sent);
+						message.read(&ping_received);
+						message.read(&pong_sent);
+						if (!message.failed && bot.clock_sync.pong(ping_sent, ping_received, pong_sent, monotonic_ns()) && measuring) {
+							clock_offset_us.add(uint64_t(std::abs(bot.clock_sync.offset_ns)) / 1000);
+						}
+					} else if (message.header.type == ServerSnapshot) {
+						Snapshot const &snapshot = bot.snapshots.receive(message);
+						//ack it, as the real client does:
+						MessageWriter ack(*c, ClientSnapshotAck, uint32_t(varint_size(snapshot.sequence)));
+						ack.write_varint(snapshot.sequence);
+						if (observer && measuring) {
+							auto now = Clock::now();
+							if (bot.last_snapshot != Clock::time_point()) {
+								snapshot_interval_us.add(uint64_t(std::chrono::duration< double, std::micro >(now - bot.last_snapshot).count()));
+							}
+							bot.last_snapshot = now;
+							for (auto const &other : snapshot.players) {
+								auto f = sent.find(key_for(other.position));
+								if (f == sent.end()) {
+									positions_unrecognized += 1;
+									continue;
+								}
+								uint64_t age = uint64_t(std::chrono::duration< double, std::micro >(now - f->second.time).count());
+								staleness_us.add(age);
+								if (!f->second.seen) {
+									update_rtt_us.add(age);
+									f->second.seen = true;
+								}
+							}
+						}
+					}
+					//(other messages -- e.g. status text -- are just skipped)
+					bytes_received += header.total_size();
+					messages_received += 1;
+					c->recv_buffer.pop(header.total_size());
+				}
+			}, 0.0);
+		}
+
+		auto now = Clock::now();
+		if (measuring) frame_us.add(uint64_t(std::chrono::duration< double, std::micro >(now - frame_start).count()));
+
+		if (now >= next_prune) {
+			next_prune += after(1.0);
+			for (auto s = sent.begin(); s != sent.end(); /*later*/) {
+				if (now - s->second.time > after(SentLifetime)) s = sent.erase(s);
+				else ++s;
+			}
+		}
+
+		if (now >= next_report) {
+			next_report += after(ReportInterval);
+			uint32_t connected = 0;
+			for (auto const &bot : bots) connected += (bot.connected ? 1 : 0);
+			std::cout << "[bots] " << uint32_t(std::chrono::duration< double >(now - start).count()) << "s: "
+				<< connected << " connected, "
+				<< (messages_received - messages_at_report) / ReportInterval << " messages/s, "
+				<< "update rtt p50/p99 " << update_rtt_us.percentile(0.5) / 1000.0 << "/" << update_rtt_us.percentile(0.99) / 1000.0 << " ms, "
+				<< "staleness p50/p99 " << staleness_us.percentile(0.5) / 1000.0 << "/" << staleness_us.percentile(0.99) / 1000.0 << " ms, "
+				<< "frame p99 " << frame_us.percentile(0.99) / 1000.0 << " ms" << std::endl;
+			messages_at_report = messages_received;
+		}
+
+		//wait for the next frame (or, if behind, skip ahead rather than trying to catch up):
+		next_frame += after(frame);
+		if (next_frame < now) next_frame = now;
+		std::this_thread::sleep_until(next_frame);
+	}
+
+	//------------ report ------------
+
+	//fetch the server's metrics report (see Metrics.hpp), if asked:
+	std::string server_metrics;
+	if (server_metrics_port != "") {
+		try {
+			Client metrics(host, server_metrics_port);
+			metrics.connection.send_raw("bots\n", 5);
+			bool open = true;
+			auto asked = Clock::now();
+			while (open && Clock::now() - asked < std::chrono::seconds(2)) {
+				metrics.poll([&](Connection *, Connection::Event event){
+					if (event == Connection::OnClose) open = false;
+				}, 0.1);
+			}
+			server_metrics = metrics.connection.recv_buffer.peek_string(0, metrics.connection.recv_buffer.size());
+		} catch (std::exception const &e) {
+			std::cerr << "[bots] couldn't fetch server metrics: " << e.what() << std::endl;
+		}
+	}
+
+	auto report = [&](MetricsWriter::Format format) -> std::string {
+		MetricsWriter out(format);
+		uint32_t connected = 0;
+		for (auto const &bot : bots) connected += (bot.connected ? 1 : 0);
+		out.value("bots", uint64_t(count));
+		out.value("connected", uint64_t(connected));
+		out.value("seconds", seconds);
+		out.value("messages_received", messages_received);
+		out.value("bytes_received", bytes_received);
+		out.value("state_messages_sent", state_messages_sent);
+		out.value("datagrams_sent", datagrams_sent);
+		out.value("positions_unrecognized", positions_unrecognized);
+		out.histogram("update_rtt_us", update_rtt_us);
+		out.histogram("staleness_us", staleness_us);
+		out.histogram("snapshot_interval_us", snapshot_interval_us);
+		out.histogram("frame_us", frame_us);
+		{ //ping round trips of all bots:
+			RoundTrips round_trips;
+			for (auto const &bot : bots) {
+				round_trips.rtt_us.merge(bot.clock_sync.round_trips.rtt_us);
+				round_trips.jitter_us.merge(bot.clock_sync.round_trips.jitter_us);
+			}
+			out.histogram("ping_rtt_us", round_trips.rtt_us);
+			out.histogram("ping_jitter_us", round_trips.jitter_us);
+		}
+		out.histogram("clock_offset_us", clock_offset_us);
+		out.begin("decompress");
+		out.value("messages", decompress_messages);
+		out.value("bytes_in", decompress_bytes_in);
+		out.value("bytes_out", decompress_bytes_out);
+		out.value("mb_per_s", decompress_ns ? double(decompress_bytes_out) * 1e3 / double(decompress_ns) : 0.0);
+		out.end();
+		if (server_metrics != "") {
+			//pass along the server's tick and latency stats:
+			out.begin("server");
+			std::istringstream lines(server_metrics);
+			std::string line;
+			while (std::getline(lines, line)) {
+				if (line.compare(0, 5, "tick.") != 0 && line.compare(0, 8, "latency.") != 0) continue;
+				auto space = line.find(' ');
+				if (space == std::string::npos) continue;
+				std::string name = line.substr(0, space);
+				for (auto &ch : name) if (ch == '.') ch = '_';
+				out.value(name, std::stod(line.substr(space + 1)));
+			}
+			out.end();
+		}
+		return out.finish();
+	};
+
+	std::cout << report(MetricsWriter::Text);
+	if (report_json != "") {
+		std::ofstream json(report_json, std::ios::app);
+		json << report(MetricsWriter::JSON) << '\n';
+	}
+
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
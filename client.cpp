@@ -14,6 +14,7 @@
 #include <stdexcept>
 #include <memory>
 #include <algorithm>
+#include <cstdlib>
 
 #ifdef _WIN32
 extern "C" { uint32_t GetACP(); }
@@ -34,8 +35,23 @@ int main(int argc, char **argv) {
 	try {
 #endif
 	//------------ command line arguments ------------
-	if (argc != 3) {
-		std::cerr << "Usage:\n\t./client <host> <port>" << std::endl;
+	bool network_thread = false; //do network I/O on its own thread (see ClientThread.hpp)
+	double send_rate = 0.0; //updates sent to the server per second (0 => once per server tick; see PlayMode.hpp)
+	bool usage = (argc < 3);
+	for (int argi = 3; argi < argc && !usage; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--network-thread") {
+			network_thread = true;
+		} else if (arg == "--send-rate" && argi + 1 < argc) {
+			argi += 1;
+			send_rate = std::atof(argv[argi]);
+			if (!(send_rate > 0.0)) usage = true;
+		} else {
+			usage = true;
+		}
+	}
+	if (usage) {
+		std::cerr << "Usage:\n\t./client <host> <port> [--network-thread] [--send-rate <updates per second>]" << std::endl;
 		return 1;
 	}
 
@@ -109,7 +125,7 @@ int main(int argc, char **argv) {
 	call_load_functions();
 
 	//------------ create game mode + make current --------------
-	Mode::set_current(std::make_shared< PlayMode >(client));
+	Mode::set_current(std::make_shared< PlayMode >(client, network_thread, send_rate));
 
 	//------------ main loop ------------
 
@@ -0,0 +1,200 @@
+//Compression benchmark: measures compress_message() / decompress_message() (see Message.hpp, Compress.hpp)
+// on 's' messages built from the snapshots in a tick log (see TickLog.hpp), so the numbers are for
+// real player positions.
+//
+//For every recorded tick and room, it builds the room's snapshot as a full 's' message (what a client
+// gets with no baseline) and as a delta against the room's snapshot from the tick before (what a client
+// that acked every snapshot gets; each with the room's whole player list in view, so these are the
+// biggest 's' messages that room could produce). Each kind is then compressed, and the ones that shrank
+// decompressed (and checked), over and over for at least --seconds each.
+//
+//For example:
+// ./server 15466 --record session.tick   (then run some clients or bots, and stop the server)
+// ./compress-bench session.tick
+
+#include "TickLog.hpp"
+#include "Snapshot.hpp"
+#include "Message.hpp"
+#include "Protocol.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+extern "C" { uint32_t GetACP(); }
+#endif
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	//------------ argument parsing ------------
+
+	std::string log_path;
+	double seconds = 0.5; //minimum time to spend compressing (and decompressing) each kind of message
+	bool args_ok = true;
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--seconds" && argi + 1 < argc) {
+			argi += 1;
+			seconds = std::stod(argv[argi]);
+		} else if (log_path.empty() && arg.substr(0,2) != "--") {
+			log_path = arg;
+		} else {
+			args_ok = false;
+			break;
+		}
+	}
+	if (!args_ok || log_path.empty()) {
+		std::cerr << "Usage:\n\t./compress-bench <file.tick> [--seconds <s>]" << std::endl;
+		return 1;
+	}
+
+	//------------ build messages from the log's snapshots ------------
+
+	TickLogReader log(log_path);
+	PositionFormat const &format = log.settings.position_format;
+
+	struct Kind {
+		std::string name;
+		std::vector< std::vector< char > > messages;
+	};
+	Kind full{"'s' full", {}};
+	Kind delta{"'s' delta", {}};
+
+	std::unordered_map< uint32_t, Snapshot > previous; //each room's snapshot from the tick before
+	std::vector< TickLog::RoomSnapshot > snapshots;
+	SnapshotDelta encoder;
+	encoder.records = std::make_shared< std::vector< char > >();
+	std::vector< char > header;
+	uint32_t sequence = 0;
+	uint64_t ticks = 0;
+
+	//(players never have id 0, so message_header() leaves nobody out)
+	auto add_message = [&](Kind &kind) {
+		size_t skip_begin, skip_end;
+		encoder.message_header(0, &header, &skip_begin, &skip_end);
+		std::vector< char > message(header);
+		message.insert(message.end(), encoder.records->begin(), encoder.records->end());
+		kind.messages.emplace_back(std::move(message));
+	};
+
+	TickLog::Record record;
+	while (log.next(&record)) {
+		if (record.type != TickLog::TickEnd) continue;
+		if (!TickLog::read_snapshots(record.data, record.size, &snapshots)) {
+			throw std::runtime_error("Tick log has a garbled snapshot.");
+		}
+		ticks += 1;
+		sequence += 1;
+		for (auto &room : snapshots) {
+			if (room.snapshot.players.empty()) continue;
+			room.snapshot.sequence = sequence;
+
+			encoder.encode(nullptr, room.snapshot, format);
+			add_message(full);
+
+			auto f = previous.find(room.room);
+			if (f != previous.end() && f->second.sequence + 1 == sequence) {
+				encoder.encode(&f->second, room.snapshot, format);
+				add_message(delta);
+			}
+			previous[room.room] = room.snapshot;
+		}
+	}
+	std::cout << "Read " << ticks << " ticks from '" << log_path << "' (" << uint32_t(format.bits) << "-bit positions)." << std::endl;
+
+	//------------ benchmark ------------
+
+	typedef std::chrono::steady_clock Clock;
+
+	std::cout << std::left << std::setw(12) << "message" << std::right
+		<< std::setw(10) << "count" << std::setw(12) << "avg bytes" << std::setw(10) << "shrunk"
+		<< std::setw(10) << "ratio" << std::setw(16) << "compress MB/s" << std::setw(18) << "decompress MB/s" << std::endl;
+
+	for (Kind const *kind : {&full, &delta}) {
+		if (kind->messages.empty()) continue;
+		size_t bytes_in = 0;
+		for (auto const &message : kind->messages) {
+			bytes_in += message.size();
+		}
+
+		//compress (keeping the results of the first pass, to decompress):
+		std::vector< std::vector< char > > compressed(kind->messages.size());
+		std::vector< char > out;
+		uint64_t passes = 0;
+		auto before = Clock::now();
+		do {
+			for (size_t i = 0; i < kind->messages.size(); ++i) {
+				out.clear();
+				compress_message(kind->messages[i].data(), kind->messages[i].size(), &out);
+				if (passes == 0) compressed[i] = out;
+			}
+			passes += 1;
+		} while (std::chrono::duration< double >(Clock::now() - before).count() < seconds);
+		double compress_s = std::chrono::duration< double >(Clock::now() - before).count();
+		double compress_mb_per_s = double(bytes_in) * double(passes) / compress_s * 1e-6;
+
+		//stats for the messages as the server would send them (compressed only if that shrunk them):
+		uint64_t shrunk = 0;
+		size_t bytes_out = 0, shrunk_bytes = 0;
+		for (size_t i = 0; i < kind->messages.size(); ++i) {
+			if (compressed[i].empty()) {
+				bytes_out += kind->messages[i].size();
+			} else {
+				shrunk += 1;
+				bytes_out += compressed[i].size();
+				shrunk_bytes += kind->messages[i].size();
+			}
+		}
+
+		//decompress the ones that shrunk (checking they come back the same):
+		double decompress_mb_per_s = 0.0;
+		if (shrunk) {
+			std::vector< char > inflated;
+			passes = 0;
+			before = Clock::now();
+			do {
+				for (size_t i = 0; i < kind->messages.size(); ++i) {
+					if (compressed[i].empty()) continue;
+					MessageReader reader(compressed[i].data(), compressed[i].size());
+					if (reader.failed || !decompress_message(reader, &inflated, MaxMessageHeaderSize + MaxServerPayload)) {
+						throw std::runtime_error("A compressed message didn't decompress.");
+					}
+					if (passes == 0 && inflated != kind->messages[i]) {
+						throw std::runtime_error("A compressed message decompressed to something else.");
+					}
+				}
+				passes += 1;
+			} while (std::chrono::duration< double >(Clock::now() - before).count() < seconds);
+			double decompress_s = std::chrono::duration< double >(Clock::now() - before).count();
+			decompress_mb_per_s = double(shrunk_bytes) * double(passes) / decompress_s * 1e-6;
+		}
+
+		std::cout << std::left << std::setw(12) << kind->name << std::right
+			<< std::setw(10) << kind->messages.size()
+			<< std::setw(12) << std::fixed << std::setprecision(1) << double(bytes_in) / double(kind->messages.size())
+			<< std::setw(10) << shrunk
+			<< std::setw(10) << std::setprecision(2) << double(bytes_in) / double(bytes_out)
+			<< std::setw(16) << std::setprecision(0) << compress_mb_per_s
+			<< std::setw(18) << decompress_mb_per_s << std::endl;
+	}
+
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "RingBuffer.hpp"
+
 #include <string>
 #include <vector>
 
@@ -11,3 +13,9 @@ template< typename T >
 std::string hex_dump(std::vector< T > const &data) {
 	return hex_dump(data.data(), data.size() * sizeof(T));
 }
+
+//helper for usage on ring buffers (e.g., Connection::recv_buffer):
+// (note: rearranges the buffer's storage so its contents are contiguous)
+inline std::string hex_dump(RingBuffer &data) {
+	return hex_dump(data.linearize(), data.size());
+}
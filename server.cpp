@@ -1,13 +1,33 @@
 
-#include "Connection.hpp"
-
-#include "hex_dump.hpp"
+#include "ShardedServer.hpp"
+#include "DatagramSocket.hpp"
+#include "Message.hpp"
+#include "Protocol.hpp"
+#include "Metrics.hpp"
+#include "Snapshot.hpp"
+#include "PositionFormat.hpp"
+#include "Room.hpp"
+#include "WorkerPool.hpp"
+#include "TickScheduler.hpp"
+#include "TickLog.hpp"
+#include "ClockSync.hpp"
+#include "SlotMap.hpp"
+#include "WalkMesh.hpp"
+#include "data_path.hpp"
+
+#include "Log.hpp"
 
 #include <chrono>
 #include <stdexcept>
 #include <iostream>
 #include <cassert>
 #include <unordered_map>
+#include <memory>
+#include <atomic>
+#include <cstring>
+#include <random>
+#include <algorithm>
+#include <fstream>
 #include <glm/glm.hpp>
 
 #ifdef _WIN32
@@ -31,191 +51,596 @@ int main(int argc, char **argv) {
 
 	//------------ argument parsing ------------
 
-	if (argc != 2) {
-		std::cerr << "Usage:\n\t./server <port>" << std::endl;
+	std::string port;
+	uint32_t threads = 0; //reactor threads (0 => do all socket work on the main thread)
+	uint32_t position_bits = 16; //bits per axis of positions on the wire (0 => raw glm::vec3; see PositionFormat.hpp)
+	//interest management -- other players within near_radius are sent every tick, those within far_radius
+	// every far_interval ticks, and those farther away not at all:
+	float near_radius = 20.0f;
+	float far_radius = 40.0f;
+	uint32_t far_interval = 3;
+	uint32_t compress_min = 128; //server messages of at least this many bytes are compressed, for clients that can take it (0 => never)
+	double tick_rate = 30.0; //ticks per second
+	uint32_t room_size = 0; //players per room -- each room is its own match (0 => everyone plays in one room)
+	uint32_t workers = 0; //threads (besides the main thread) that tick rooms (0 => tick them all on the main thread)
+	TickScheduler::Policy tick_policy = TickScheduler::CatchUp; //what happens to ticks that start a whole period late (see TickScheduler.hpp)
+	std::string metrics_port; //if set, serve a text metrics report on this (localhost-only) port
+	std::string metrics_log; //if set, append a JSON metrics report to this file every MetricsLogInterval
+	std::string record; //if set, record every tick's inputs and snapshot to this tick log (see TickLog.hpp)
+	std::string replay; //if set, re-run the ticks in this tick log (no sockets; as fast as possible) instead of serving
+	bool args_ok = true;
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--threads" && argi + 1 < argc) {
+			argi += 1;
+			threads = uint32_t(std::stoul(argv[argi]));
+		} else if (arg == "--position-bits" && argi + 1 < argc) {
+			argi += 1;
+			position_bits = uint32_t(std::stoul(argv[argi]));
+		} else if (arg == "--near-radius" && argi + 1 < argc) {
+			argi += 1;
+			near_radius = std::stof(argv[argi]);
+		} else if (arg == "--far-radius" && argi + 1 < argc) {
+			argi += 1;
+			far_radius = std::stof(argv[argi]);
+		} else if (arg == "--far-interval" && argi + 1 < argc) {
+			argi += 1;
+			far_interval = uint32_t(std::stoul(argv[argi]));
+		} else if (arg == "--compress-min" && argi + 1 < argc) {
+			argi += 1;
+			compress_min = uint32_t(std::stoul(argv[argi]));
+		} else if (arg == "--tick-rate" && argi + 1 < argc) {
+			argi += 1;
+			tick_rate = std::stod(argv[argi]);
+		} else if (arg == "--room-size" && argi + 1 < argc) {
+			argi += 1;
+			room_size = uint32_t(std::stoul(argv[argi]));
+		} else if (arg == "--workers" && argi + 1 < argc) {
+			argi += 1;
+			workers = uint32_t(std::stoul(argv[argi]));
+		} else if (arg == "--tick-policy" && argi + 1 < argc) {
+			argi += 1;
+			if (!TickScheduler::parse_policy(argv[argi], &tick_policy)) {
+				std::cerr << "Unknown tick policy '" << argv[argi] << "'." << std::endl;
+				args_ok = false;
+				break;
+			}
+		} else if (arg == "--metrics-port" && argi + 1 < argc) {
+			argi += 1;
+			metrics_port = argv[argi];
+		} else if (arg == "--metrics-log" && argi + 1 < argc) {
+			argi += 1;
+			metrics_log = argv[argi];
+		} else if (arg == "--record" && argi + 1 < argc) {
+			argi += 1;
+			record = argv[argi];
+		} else if (arg == "--replay" && argi + 1 < argc) {
+			argi += 1;
+			replay = argv[argi];
+		} else if (port.empty() && arg.substr(0,2) != "--") {
+			port = arg;
+		} else {
+			args_ok = false;
+			break;
+		}
+	}
+	if (position_bits > PositionFormat::MaxBits) {
+		std::cerr << "--position-bits must be at most " << uint32_t(PositionFormat::MaxBits) << "." << std::endl;
+		args_ok = false;
+	}
+	if (!(near_radius >= 0.0f && far_radius > 0.0f && near_radius <= far_radius && far_interval > 0)) {
+		std::cerr << "Need 0 <= --near-radius <= --far-radius, 0 < --far-radius, and 0 < --far-interval." << std::endl;
+		args_ok = false;
+	}
+	if (!(tick_rate > 0.0)) {
+		std::cerr << "Need 0 < --tick-rate." << std::endl;
+		args_ok = false;
+	}
+	if (replay != "" && (port != "" || record != "" || room_size != 0)) {
+		std::cerr << "--replay doesn't take a port, --record, or --room-size." << std::endl;
+		args_ok = false;
+	}
+	if (!args_ok || (port.empty() && replay.empty())) {
+		std::cerr << "Usage:\n\t./server <port> [--threads <count>] [--position-bits <bits>] [--near-radius <r>] [--far-radius <r>] [--far-interval <ticks>] [--compress-min <bytes>] [--tick-rate <hz>] [--tick-policy <catch-up|skip>] [--room-size <players>] [--workers <count>] [--metrics-port <port>] [--metrics-log <file.jsonl>] [--record <file.tick>]"
+			"\n\t./server --replay <file.tick> [--compress-min <bytes>] [--workers <count>] [--metrics-port <port>] [--metrics-log <file.jsonl>]" << std::endl;
 		return 1;
 	}
 
 	//------------ initialization ------------
 
-	Server server(argv[1]);
-	std::string status_message = "";
+	//when replaying, the log stands in for the sockets (and decides the settings that affect ticks):
+	std::unique_ptr< TickLogReader > replay_log;
+	if (replay != "") {
+		replay_log = std::make_unique< TickLogReader >(replay);
+		near_radius = replay_log->settings.near_radius;
+		far_radius = replay_log->settings.far_radius;
+		far_interval = replay_log->settings.far_interval;
+		tick_rate = replay_log->settings.tick_rate;
+	}
 
+	//client messages are framed as in Message.hpp, and are of type 'b', 'a', 'c', or 'q' (see Protocol.hpp):
+	std::unique_ptr< ShardedServer > server; //(null when replaying)
+	if (!replay_log) {
+		server = std::make_unique< ShardedServer >(port, threads, [](RingBuffer const &buffer) -> size_t {
+			MessageHeader header;
+			MessageStatus status = peek_message(buffer, &header, MaxClientPayload);
+			if (status == MessageIncomplete) return 0;
+			if (status == MessageMalformed || (header.type != ClientState && header.type != ClientSnapshotAck && header.type != ClientCapabilities && header.type != ClientPing)) {
+				LOG_WARN("malformed message or message of unknown type received from client!");
+				return ShardedServer::Reject;
+			}
+			return header.total_size();
+		});
+	}
 
-	//------------ main loop ------------
-	constexpr float ServerTick = 1.0f / 30.0f; 
+	//everyone plays on the level's walkmesh:
+	WalkMeshes walkmeshes(data_path("twin-circles.w"));
+	WalkMesh const &walkmesh = walkmeshes.lookup("WalkMesh");
 
-	//server state:
+	//positions are quantized within the walkmesh (and every client is told so with an 'f' message):
+	PositionFormat position_format;
+	if (replay_log) {
+		position_format = replay_log->settings.position_format;
+	} else {
+		position_format = PositionFormat::for_walkmesh(walkmesh, uint8_t(position_bits));
+	}
+	if (position_format.bits != 0) {
+		glm::vec3 precision = position_format.precision();
+		std::cout << "Positions are " << uint32_t(position_format.bits) << " bits per axis (" << position_format.size() << " bytes; precision "
+			<< std::max(precision.x, std::max(precision.y, precision.z)) << " units)." << std::endl;
+	}
 
-	//per-client state:
-	struct PlayerInfo {
-		PlayerInfo() {
-			static uint32_t next_player_id = 1;
-			name = "Player" + std::to_string(next_player_id);
-			next_player_id += 1;
-		}
-		std::string name;
+	//every room plays by the same settings:
+	Room::Settings room_settings;
+	room_settings.position_format = position_format;
+	//(the interest grid covers the walkmesh itself, not the position format's box -- which means nothing with --position-bits 0)
+	room_settings.level_min = room_settings.level_max = glm::vec2(walkmesh.vertices.at(0));
+	for (glm::vec3 const &v : walkmesh.vertices) {
+		room_settings.level_min = glm::min(room_settings.level_min, glm::vec2(v));
+		room_settings.level_max = glm::max(room_settings.level_max, glm::vec2(v));
+	}
+	room_settings.near_radius = near_radius;
+	room_settings.far_radius = far_radius;
+	room_settings.far_interval = far_interval;
+	room_settings.compress_min = compress_min;
+
+	//position updates also arrive as datagrams on the same port number:
+	// [p] - 1 byte
+	// [token] - 4 bytes, as sent to the client in its 'u' message
+	// [sequence number] - 4 bytes, increasing (older datagrams are dropped)
+	// [position] - PositionFormat::size() bytes
+	size_t const DatagramMessageSize = 1 + 4 + 4 + position_format.size();
+	std::unique_ptr< DatagramSocket > datagrams; //(null when replaying)
+	if (!replay_log) {
+		datagrams = std::make_unique< DatagramSocket >(port);
+	}
 
-		uint32_t num_pies_collected = 0;
-		uint32_t flag = 0;
+	std::unique_ptr< TickRecorder > recorder;
+	if (record != "") {
+		TickLog::Settings settings;
+		settings.position_format = position_format;
+		settings.near_radius = near_radius;
+		settings.far_radius = far_radius;
+		settings.far_interval = far_interval;
+		settings.tick_rate = tick_rate;
+		recorder = std::make_unique< TickRecorder >(record, settings);
+		std::cout << "Recording ticks to '" << record << "'." << std::endl;
+	}
 
-		int32_t total = 0;
+	std::unique_ptr< MetricsEndpoint > metrics_endpoint;
+	if (metrics_port != "") {
+		metrics_endpoint = std::make_unique< MetricsEndpoint >(metrics_port);
+	}
+	constexpr double MetricsLogInterval = 10.0; //seconds between reports appended to metrics_log
 
-		glm::vec3 position;
 
+	//------------ main loop ------------
+	TickScheduler scheduler(tick_rate, tick_policy);
+	scheduler.free_running = bool(replay_log);
+
+	//server state:
+
+	//each room is an independent match (see Room.hpp); connections are put in a room when they connect:
+	std::vector< std::unique_ptr< Room > > rooms;
+	//where each connection's player is:
+	struct Seat {
+		uint32_t room = 0; //index in rooms
+		Room::PlayerHandle player = 0;
 	};
-	std::unordered_map< Connection *, PlayerInfo > players;
+	SlotMap< Seat > seats; //named by ConnectionId (see ShardedServer.hpp), so lookups are an array index
+	std::unordered_map< uint32_t, ConnectionId > datagram_tokens;
+	std::mt19937 token_generator{std::random_device()()};
+
+	//rooms are ticked on a pool of threads, longest (as of their last tick) first:
+	WorkerPool pool(workers);
+	std::vector< Room * > ticking; //(rooms with players, this tick)
+
+	//(room ticks are timed by the rooms; tick timing is kept by the scheduler)
+	Histogram players_per_tick; //players (in all rooms) each tick
+	Histogram rooms_per_tick; //rooms with players each tick
+	Histogram room_players; //players in each ticked room, each tick
+	Histogram room_work_us; //simulate() + serialize() time of each ticked room, each tick
+	auto start_time = std::chrono::steady_clock::now();
+	std::vector< ShardedServer::ShardStats > shard_stats;
+
+	//report all stats (for the metrics endpoint / log):
+	auto report_metrics = [&](MetricsWriter::Format format) -> std::string {
+		MetricsWriter out(format);
+		out.value("uptime_s", std::chrono::duration< double >(std::chrono::steady_clock::now() - start_time).count());
+
+		Room::Stats room_stats;
+		for (auto const &room : rooms) {
+			room_stats.merge(room->stats);
+		}
 
-	PlayerInfo *winner = NULL;
-	while (true) {
-		static auto next_tick = std::chrono::steady_clock::now() + std::chrono::duration< double >(ServerTick);
-		//process incoming data from clients until a tick has elapsed:
-		while (true) {
-			auto now = std::chrono::steady_clock::now();
-			double remain = std::chrono::duration< double >(next_tick - now).count();
-			if (remain < 0.0) {
-				next_tick += std::chrono::duration< double >(ServerTick);
-				break;
+		out.begin("tick");
+		out.value("rate", tick_rate);
+		out.value("count", scheduler.stats.ticks);
+		out.value("overruns", scheduler.stats.overruns);
+		out.value("caught_up", scheduler.stats.caught_up);
+		out.value("skipped", scheduler.stats.skipped);
+		out.histogram("start_late_us", scheduler.stats.start_late_us);
+		out.histogram("work_us", scheduler.stats.work_us);
+		for (uint32_t p = 0; p < TickScheduler::PhaseCount; ++p) {
+			out.histogram(std::string(TickScheduler::phase_name(TickScheduler::Phase(p))) + "_us", scheduler.stats.phase_us[p]);
+		}
+		out.value("players_now", uint64_t(seats.size()));
+		out.histogram("players", players_per_tick);
+		out.histogram("snapshot_bytes", room_stats.snapshot_bytes);
+		out.value("full_snapshots", room_stats.full_snapshots);
+		out.value("delta_snapshots", room_stats.delta_snapshots);
+		out.histogram("near_players", room_stats.near_players);
+		out.histogram("far_players", room_stats.far_players);
+		out.value("datagrams", room_stats.datagrams);
+		out.begin("compress");
+		out.value("messages", room_stats.compress_messages);
+		out.value("shrunk", room_stats.compress_shrunk);
+		out.value("bytes_in", room_stats.compress_bytes_in);
+		out.value("bytes_out", room_stats.compress_bytes_out);
+		out.value("mb_per_s", room_stats.compress_ns ? double(room_stats.compress_bytes_in) * 1e3 / double(room_stats.compress_ns) : 0.0);
+		out.end();
+		out.end();
+
+		out.begin("rooms");
+		{
+			uint64_t active = 0;
+			for (auto const &room : rooms) {
+				if (room->players.size() != 0) active += 1;
+			}
+			out.value("size", uint64_t(room_size));
+			out.value("workers", uint64_t(pool.threads()));
+			out.value("count", uint64_t(rooms.size()));
+			out.value("active_now", active);
+			out.histogram("active", rooms_per_tick);
+			out.histogram("players", room_players);
+			out.histogram("work_us", room_work_us);
+		}
+		out.end();
+
+		out.begin("latency");
+		{ //every round trip so far, and each current player's smoothed round trip time and jitter:
+			Histogram rtt_us = room_stats.departed_round_trips.rtt_us;
+			Histogram jitter_us = room_stats.departed_round_trips.jitter_us;
+			Histogram player_rtt_us, player_jitter_us;
+			for (auto const &room : rooms) {
+				for (Room::PlayerInfo const &player : room->players) {
+					rtt_us.merge(player.round_trips.rtt_us);
+					jitter_us.merge(player.round_trips.jitter_us);
+					if (player.round_trips.count() == 0) continue;
+					player_rtt_us.add(uint64_t(player.round_trips.rtt * 1e6));
+					player_jitter_us.add(uint64_t(player.round_trips.jitter * 1e6));
+				}
 			}
-			server.poll([&](Connection *c, Connection::Event evt){
-				if (evt == Connection::OnOpen) {
-					//client connected:
+			out.histogram("rtt_us", rtt_us);
+			out.histogram("jitter_us", jitter_us);
+			out.histogram("player_rtt_us", player_rtt_us);
+			out.histogram("player_jitter_us", player_jitter_us);
+		}
+		out.end();
+
+		if (server) server->collect_stats(&shard_stats); //(no shards when replaying)
+		Connection::Stats total;
+		size_t total_connections = 0;
+		out.begin("shards");
+		for (size_t i = 0; i < shard_stats.size(); ++i) {
+			out.begin(std::to_string(i));
+			out.value("connections", uint64_t(shard_stats[i].connections.size()));
+			out.value("polls", shard_stats[i].poll.polls);
+			out.histogram("poll_busy_us", shard_stats[i].poll.busy_us);
+			out.end();
+		}
+		out.end();
+		out.begin("connections");
+		for (auto const &shard : shard_stats) {
+			for (auto const &[id, stats] : shard.connections) {
+				out.begin(std::to_string(id));
+				out.value("bytes_in", stats.bytes_in);
+				out.value("bytes_out", stats.bytes_out);
+				out.value("messages_in", stats.messages_in);
+				out.value("messages_out", stats.messages_out);
+				out.value("send_queue_high_water", uint64_t(stats.send_queue_high_water));
+				out.value("messages_superseded", stats.messages_superseded);
+				out.histogram("recv_bursts", stats.recv_bursts);
+				out.end();
+
+				total_connections += 1;
+				total.bytes_in += stats.bytes_in;
+				total.bytes_out += stats.bytes_out;
+				total.messages_in += stats.messages_in;
+				total.messages_out += stats.messages_out;
+				total.send_queue_high_water = std::max(total.send_queue_high_water, stats.send_queue_high_water);
+				total.messages_superseded += stats.messages_superseded;
+				total.recv_bursts.merge(stats.recv_bursts);
+			}
+		}
+		out.end();
+		out.begin("connections_total"); //(of currently open connections)
+		out.value("count", uint64_t(total_connections));
+		out.value("bytes_in", total.bytes_in);
+		out.value("bytes_out", total.bytes_out);
+		out.value("messages_in", total.messages_in);
+		out.value("messages_out", total.messages_out);
+		out.value("send_queue_high_water", uint64_t(total.send_queue_high_water));
+		out.value("messages_superseded", total.messages_superseded);
+		out.histogram("recv_bursts", total.recv_bursts);
+		out.end();
+
+		return out.finish();
+	};
+	auto next_metrics_log = start_time + std::chrono::duration< double >(MetricsLogInterval);
 
-					//create some player info for them:
-					players.emplace(c, PlayerInfo());
+	//the inputs to a tick -- from the sockets, or from a tick log when replaying:
 
+	auto room_at = [&](uint32_t index) -> Room & {
+		while (rooms.size() <= index) {
+			rooms.emplace_back(std::make_unique< Room >(room_settings));
+		}
+		return *rooms[index];
+	};
 
-				} else if (evt == Connection::OnClose) {
-					//client disconnected:
+	//put a new player in the first room with space (making one if needed); returns false if that room is out of player ids:
+	// (when replaying, 'room' comes from the log instead)
+	auto add_player = [&](ConnectionId c, uint32_t token, uint32_t room) -> bool {
+		Room::PlayerHandle player = room_at(room).add_player(c, token);
+		if (!player) return false;
+		Seat seat;
+		seat.room = room;
+		seat.player = player;
+		seats.insert_at(c, std::move(seat));
+		datagram_tokens.emplace(token, c);
+		return true;
+	};
+	auto pick_room = [&]() -> uint32_t {
+		if (room_size == 0) return 0;
+		for (uint32_t r = 0; r < rooms.size(); ++r) {
+			if (rooms[r]->players.size() < room_size) return r;
+		}
+		return uint32_t(rooms.size());
+	};
 
-					//remove them from the players list:
-					auto f = players.find(c);
-					assert(f != players.end());
-					players.erase(f);
+	auto remove_player = [&](ConnectionId c) {
+		Seat const *seat = seats.find(c);
+		assert(seat);
+		Room &room = *rooms[seat->room];
+		datagram_tokens.erase(room.players.find(seat->player)->datagram_token);
+		room.remove_player(seat->player, server.get());
+		seats.erase(c);
+	};
 
+	//'data' is a complete 'b', 'a', 'c', or 'q' message:
+	auto handle_message = [&](ConnectionId c, char const *data, size_t size) {
+		Seat const *seat = seats.find(c);
+		if (!seat) return; //(a connection that was turned away; see OnOpen)
+		rooms[seat->room]->handle_message(seat->player, data, size, server.get());
+	};
 
-				} else { assert(evt == Connection::OnRecv);
-					//got data from client:
-					std::cout << "got bytes:\n" << hex_dump(c->recv_buffer); std::cout.flush();
+	auto handle_datagram = [&](char const *data, size_t size) {
+		if (size != DatagramMessageSize || data[0] != 'p') return; //not ours; ignore
+		uint32_t token = (uint32_t(uint8_t(data[1])) << 24) | (uint32_t(uint8_t(data[2])) << 16) | (uint32_t(uint8_t(data[3])) << 8) | uint32_t(uint8_t(data[4]));
+		auto f = datagram_tokens.find(token);
+		if (f == datagram_tokens.end()) return; //unknown (or departed) player
+		Seat const &seat = *seats.find(f->second);
+		rooms[seat.room]->handle_datagram(seat.player, data, server.get());
+	};
 
-					//look up in players list:
-					auto f = players.find(c);
-					assert(f != players.end());
-					PlayerInfo &player = f->second;
+	//replaying: feed the log's records to the handlers above, starting the tick where it started;
+	// stops after the tick's inputs (leaving its recorded snapshots in 'expected'), or returns false at the end of the log:
+	std::vector< TickLog::RoomSnapshot > expected;
+	uint64_t replay_mismatches = 0; //ticks whose snapshots differed from the recorded ones
+	auto replay_inputs = [&]() -> bool {
+		TickLog::Record record;
+		while (replay_log->next(&record)) {
+			if (record.type == TickLog::Open) {
+				if (!add_player(record.connection, record.token, record.room)) {
+					throw std::runtime_error("Tick log opens a connection the server turned away.");
+				}
+			}
+			else if (record.type == TickLog::Close) remove_player(record.connection);
+			else if (record.type == TickLog::Message) handle_message(record.connection, record.data, record.size);
+			else if (record.type == TickLog::TickBegin) scheduler.begin_tick();
+			else if (record.type == TickLog::Datagram) handle_datagram(record.data, record.size);
+			else if (record.type == TickLog::TickEnd) {
+				if (!TickLog::read_snapshots(record.data, record.size, &expected)) {
+					throw std::runtime_error("Tick log has a garbled snapshot.");
+				}
+				return true;
+			}
+		}
+		return false;
+	};
 
-					//handle messages from client:
-					size_t message_size = 3 + sizeof(glm::vec3); // size in bytes
-					while (c->recv_buffer.size() >= message_size) {
-						//expecting five-byte messages 'b' (left count) (right count) (down count) (up count)
-						char type = c->recv_buffer[0];
-						if (type != 'b') {
-							std::cout << " message of non-'b' type received from client!" << std::endl;
-							//shut down client connection:
-							c->close();
+	while (true) {
+		if (replay_log) {
+			if (!replay_inputs()) break;
+		} else {
+			//process incoming data from clients until (nearly) time for the next tick:
+			do {
+				server->poll([&](ConnectionId c, Connection::Event evt, char const *data, size_t size){
+					if (evt == Connection::OnOpen) {
+						//client connected:
+
+						//create some player info for them, with a token to tag their position datagrams:
+						uint32_t token;
+						do {
+							token = uint32_t(token_generator());
+						} while (token == 0 || datagram_tokens.count(token));
+						uint32_t room = pick_room();
+						if (!add_player(c, token, room)) {
+							LOG_WARN("out of player ids in room " << room << "; turning away connection " << c << ".");
+							server->close(c);
 							return;
 						}
-						uint8_t num_pies_collected = c->recv_buffer[1];
-						uint8_t flag = c->recv_buffer[2];
-						if (flag == 1) {
-							winner = &player;
+						if (recorder) recorder->open(c, token, room);
+
+						//tell them how positions are encoded:
+						{
+							char message[MaxMessageHeaderSize + ServerPositionFormatPayload];
+							size_t size = encode_message_header(message, ServerPositionFormat, ServerPositionFormatPayload);
+							message[size++] = char(position_format.bits);
+							std::memcpy(message + size, &position_format.min, sizeof(glm::vec3));
+							size += sizeof(glm::vec3);
+							std::memcpy(message + size, &position_format.max, sizeof(glm::vec3));
+							size += sizeof(glm::vec3);
+							server->send(c, message, size);
 						}
 
-						glm::vec3* player_pos = reinterpret_cast<glm::vec3 *>(&(c->recv_buffer[5]));
-
-						player.num_pies_collected = num_pies_collected;
-						player.position = *player_pos;
+						//tell them how to tag their position datagrams:
+						char message[MaxMessageHeaderSize + sizeof(uint32_t)];
+						size_t header_size = encode_message_header(message, ServerDatagramToken, sizeof(uint32_t));
+						std::memcpy(message + header_size, &token, sizeof(uint32_t));
+						server->send(c, message, header_size + sizeof(uint32_t));
+
+						//tell them how often snapshots are made:
+						{
+							float rate = float(tick_rate);
+							char message[MaxMessageHeaderSize + sizeof(float)];
+							size_t size = encode_message_header(message, ServerTickRate, sizeof(float));
+							std::memcpy(message + size, &rate, sizeof(float));
+							server->send(c, message, size + sizeof(float));
+						}
 
-						c->recv_buffer.erase(c->recv_buffer.begin(), c->recv_buffer.begin() + message_size);
+						//introduce everyone else in the room to them, and them to everyone else:
+						rooms[room]->introduce(seats.find(c)->player, server.get());
+
+					} else if (evt == Connection::OnClose) {
+						//client disconnected:
+						if (!seats.find(c)) return; //(turned away; see above)
+						if (recorder) recorder->close(c);
+						remove_player(c); //(also tells everyone else in the room)
+
+					} else { assert(evt == Connection::OnRecv);
+						//got a message from client:
+						// (framing above guarantees it is a complete 'b', 'a', 'c', or 'q' message)
+						LOG_HEX(Log::Debug, "got bytes from connection " << c << ":", data, size);
+						if (recorder) recorder->message(c, data, size);
+						handle_message(c, data, size);
 					}
-				}
-			}, remain);
-		}
+				}, scheduler.poll_timeout());
+			} while (scheduler.poll_timeout() > 0.0);
 
-		//update current game state
-		status_message = "";
-		if (winner) {
-			status_message = winner->name + " wins! ";
-		} else {
-			for (auto &[c, player] : players) {
-				(void)c; //work around "unused variable" warning on whatever version of g++ github actions is running
-				if (status_message != "") status_message += " + ";
-				status_message += "( " + player.name + ": " + std::to_string(player.num_pies_collected) + " ) ";
-			}
+			scheduler.begin_tick();
+			if (recorder) recorder->tick_begin();
+
+			//read position datagrams that arrived during the tick:
+			datagrams->poll([&](char const *data, size_t size){
+				if (recorder) recorder->datagram(data, size);
+				handle_datagram(data, size);
+			});
 		}
-		//std::cout << status_message << std::endl; //DEBUG
-
-		//send updated game state to all clients
-		// Each player in the game receives a message from the server
-		// 
-		// [m] - 1 byte
-		// [status message size] - 3 bytes
-		// [status message] - number of bytes given by previous field
-		// [number of other players] - 1 byte
-		// [other PlayerData] - number of bytes can depend on each player
-
-		for (auto &[c, player] : players) {
-			(void)player; //work around "unused variable" warning on whatever g++ github actions uses
-			//send an update starting with 'm', a 24-bit size, and a blob of text:
-			c->send('m');
-			c->send(uint8_t(status_message.size() >> 16));
-			c->send(uint8_t((status_message.size() >> 8) % 256));
-			c->send(uint8_t(status_message.size() % 256));
-			c->send_buffer.insert(c->send_buffer.end(), status_message.begin(), status_message.end());
-
-			struct PlayerMessageData { // the data that gets sent to all of the players
-				std::string name;
-				glm::vec3 position;
-
-				std::vector<char> getPackedData()
-				{
-					std::vector<char> result;
-					// add the position data
-					char* _player_pos_data = reinterpret_cast<char*>(&position);
-					size_t _pos_len = sizeof(glm::vec3) / sizeof(char); // size in bytes of glm::vec3
-					for (size_t i = 0; i < _pos_len; i++)
-					{
-						result.emplace_back(_player_pos_data[i]);
-					}
-					// add the name data
-					uint8_t _name_len = name.size() + 1; // truncate the size of the name to 255 bytes. +1 is for the null terminator
-					result.emplace_back(reinterpret_cast<unsigned char>(_name_len));
-					result.insert(result.end(), name.begin(), name.end());
-					
-					return result;
-				}
 
-				size_t getPackedDataSize()
-				{
-					return sizeof(glm::vec3) + name.size() + 1;  // size of position + name.size() + 1
+		scheduler.end_phase(TickScheduler::IO);
+
+		//tick every room that has players -- rooms share nothing, so they tick in parallel:
+		// (empty rooms are skipped, and kept for later players)
+		ticking.clear();
+		for (auto const &room : rooms) {
+			if (room->players.size() != 0) ticking.emplace_back(room.get());
+		}
+		//(the longest rooms go first, so one isn't left to run alone at the end)
+		std::stable_sort(ticking.begin(), ticking.end(), [](Room const *a, Room const *b) {
+			return a->work_ns > b->work_ns;
+		});
+
+		//update current game state:
+		pool.run(uint32_t(ticking.size()), [&](uint32_t i){
+			ticking[i]->simulate();
+		});
+
+		scheduler.end_phase(TickScheduler::Simulate);
+
+		//record each room's snapshot, and build updated game state for all clients:
+		pool.run(uint32_t(ticking.size()), [&](uint32_t i){
+			ticking[i]->serialize();
+		});
+
+		//(rooms are listed by index in the log, so recording doesn't depend on the order they ticked in)
+		uint32_t room_count = 0;
+		for (uint32_t r = 0; r < rooms.size(); ++r) {
+			Room const &room = *rooms[r];
+			if (room.players.size() == 0) continue;
+			if (recorder) recorder->room_snapshot(r, room.snapshot);
+			if (replay_log) {
+				bool same = (room_count < expected.size() && expected[room_count].room == r);
+				Snapshot const &snapshot = room.snapshot;
+				Snapshot const *recorded = (same ? &expected[room_count].snapshot : nullptr);
+				same = same && (recorded->players.size() == snapshot.players.size());
+				for (size_t i = 0; same && i < snapshot.players.size(); ++i) {
+					Snapshot::Player const &a = snapshot.players[i];
+					Snapshot::Player const &b = recorded->players[i];
+					same = (a.id == b.id && a.position == b.position);
 				}
-			};
-			// other players data begins with 1 byte, that tells the player how many 
-			// PlayerData is being sent 
-			std::vector<char> other_players_data;
-			uint8_t n = players.size() - 1;
-			(void)n;
-			for (auto &[oc, oplayer] : players) { // other connection, other player
-				if (oc == c) { // skip if we are visitng ourselves
-					continue;
+				if (!same) {
+					if (replay_mismatches == 0) LOG_WARN("tick " << scheduler.stats.ticks << " doesn't match its recorded snapshot in room " << r << ".");
+					replay_mismatches += 1;
 				}
-				PlayerMessageData pmd {oplayer.name, oplayer.position};
-				std::vector<char> player_data = pmd.getPackedData();
-				other_players_data.insert(other_players_data.end(), player_data.begin(), player_data.end());
 			}
-			std::cout << uint8_t(other_players_data.size() >> 16) << std::endl;
+			room_count += 1;
+			room_players.add(room.players.size());
+			room_work_us.add(room.work_ns / 1000);
+		}
+		if (recorder) recorder->tick_end();
+		if (replay_log && room_count != expected.size()) {
+			if (replay_mismatches == 0) LOG_WARN("tick " << scheduler.stats.ticks << " ticked " << room_count << " rooms, but " << expected.size() << " were recorded.");
+			replay_mismatches += 1;
+		}
+
+		scheduler.end_phase(TickScheduler::Serialize);
 
-			static_assert(sizeof(uint8_t(other_players_data.size() >> 16)) == 1, "Byte size in message is wrong!"); // static assert is checked at compile time
-			c->send(uint8_t(other_players_data.size() >> 16));
-			static_assert(sizeof(uint8_t((other_players_data.size() >> 8) % 256)) == 1, "Byte size in message is wrong!"); // static assert is checked at compile time
-			c->send(uint8_t((other_players_data.size() >> 8) % 256));
-			c->send(uint8_t(other_players_data.size() % 256));
-			c->send(uint8_t(n));
-			c->send_buffer.insert(c->send_buffer.end(), other_players_data.begin(), other_players_data.end());
+		//send updated game state to all clients:
+		// (on the main thread, since ShardedServer is only used from there)
+		for (Room *room : ticking) {
+			room->flush(server.get());
 		}
 
+		scheduler.end_phase(TickScheduler::Flush);
+		scheduler.end_tick();
+		players_per_tick.add(seats.size());
+		rooms_per_tick.add(room_count);
+
+		//report metrics:
+		if (metrics_endpoint) {
+			metrics_endpoint->poll([&](){ return report_metrics(MetricsWriter::Text); });
+		}
+		if (metrics_log != "" && std::chrono::steady_clock::now() >= next_metrics_log) {
+			next_metrics_log += std::chrono::duration< double >(MetricsLogInterval);
+			std::ofstream log(metrics_log, std::ios::app);
+			log << report_metrics(MetricsWriter::JSON) << '\n';
+			if (!log) std::cerr << "Failed to append metrics to '" << metrics_log << "'." << std::endl;
+		}
+
+	}
+
+	//(only replays get here)
+	double elapsed = std::chrono::duration< double >(std::chrono::steady_clock::now() - start_time).count();
+	std::cout << "Replayed " << scheduler.stats.ticks << " ticks in " << elapsed << " seconds (" << double(scheduler.stats.ticks) / elapsed << " ticks/second); "
+		<< replay_mismatches << " ticks didn't match their recorded snapshots." << std::endl;
+	std::cout << report_metrics(MetricsWriter::Text);
+	if (metrics_log != "") {
+		std::ofstream log(metrics_log, std::ios::app);
+		log << report_metrics(MetricsWriter::JSON) << '\n';
 	}
 
-	return 0;
+	return replay_mismatches == 0 ? 0 : 1;
 
 #ifdef _WIN32
 	} catch (std::exception const &e) {